@@ -340,6 +340,7 @@ Dispatch(void)
     int nready;
     HWEventQueuePtr *icheck = checkForInput;
     long start_tick;
+    CARD64 profile_start;
 
     nextFreeClientID = 1;
     nClients = 0;
@@ -348,8 +349,13 @@ Dispatch(void)
     if (!clientReady)
         return;
 
+    InitRequestProfile();
+
     SmartScheduleSlice = SmartScheduleInterval;
     while (!dispatchException) {
+        if (RequestProfileDumpPending)
+            RequestProfileDump();
+
         if (*icheck[0] != *icheck[1]) {
             ProcessInputEvents();
             FlushIfCriticalOutputPending();
@@ -421,6 +427,9 @@ Dispatch(void)
                                           client->index,
                                           client->requestBuffer);
 #endif
+                profile_start = 0;
+                if (RequestProfiling && client->clientState == ClientStateRunning)
+                    profile_start = RequestProfileStart();
                 if (result > (maxBigRequestSize << 2))
                     result = BadLength;
                 else {
@@ -430,6 +439,8 @@ Dispatch(void)
                             (*client->requestVector[client->majorOp]) (client);
                     XaceHookAuditEnd(client, result);
                 }
+                if (profile_start)
+                    RequestProfileRecord(client, profile_start);
 #ifdef XSERVER_DTRACE
                 if (XSERVER_REQUEST_DONE_ENABLED())
                     XSERVER_REQUEST_DONE(LookupMajorName(client->majorOp),
@@ -3483,7 +3494,7 @@ NextAvailableClient(void *ospriv)
     xReq data;
 
     i = nextFreeClientID;
-    if (i == MAXCLIENTS)
+    if (i == LimitClients)
         return (ClientPtr) NULL;
     clients[i] = client =
         dixAllocateObjectWithPrivates(ClientRec, PRIVATE_CLIENT);
@@ -3503,7 +3514,7 @@ NextAvailableClient(void *ospriv)
     }
     if (i == currentMaxClients)
         currentMaxClients++;
-    while ((nextFreeClientID < MAXCLIENTS) && clients[nextFreeClientID])
+    while ((nextFreeClientID < LimitClients) && clients[nextFreeClientID])
         nextFreeClientID++;
 
     /* Enable client ID tracking. This must be done before
@@ -142,4 +142,11 @@ int ProcUninstallColormap(ClientPtr /* client */ );
 int ProcUnmapSubwindows(ClientPtr /* client */ );
 int ProcUnmapWindow(ClientPtr /* client */ );
 
+/* reqprofile.c */
+extern volatile char RequestProfileDumpPending;
+void InitRequestProfile(void);
+CARD64 RequestProfileStart(void);
+void RequestProfileRecord(ClientPtr /* client */ , CARD64 /* start */ );
+void RequestProfileDump(void);
+
 #endif                          /* DISPATCH_H */
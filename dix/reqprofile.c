@@ -0,0 +1,350 @@
+/*
+ * Copyright © 2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * Request dispatch profiler.
+ *
+ * Enabled with -reqprofile. Dispatch() then brackets every request of a
+ * running client with RequestProfileStart and RequestProfileRecord, which
+ * add the elapsed time to a counter per major/minor opcode and per client.
+ * Time is taken from the TSC where there is one and converted to
+ * microseconds against the monotonic clock when the profile is dumped.
+ *
+ * SIGUSR2 dumps the profile to the log and starts a new one. The signal
+ * handler only sets a flag, the dump itself happens from Dispatch() at
+ * the next dispatch cycle.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/X.h>
+#include "misc.h"
+#include "os.h"
+#include "opaque.h"
+#include "dixstruct.h"
+#include "extnsionst.h"
+#include "registry.h"
+#include "client.h"
+#include "dispatch.h"
+
+#define PROFILE_TOP_REQUESTS    20
+#define PROFILE_TOP_CLIENTS     10
+#define PROFILE_CLIENT_REQUESTS 3
+
+typedef struct {
+    CARD64 count;
+    CARD64 ticks;
+} RequestProfileRec, *RequestProfilePtr;
+
+typedef struct {
+    RequestProfileRec total;
+    RequestProfilePtr majors;   /* [256], allocated with the first request */
+} ClientProfileRec, *ClientProfilePtr;
+
+Bool RequestProfiling = FALSE;
+volatile char RequestProfileDumpPending = FALSE;
+
+static RequestProfilePtr profileRequests;      /* [256 * 256] */
+static ClientProfilePtr profileClients;        /* [LimitClients] */
+static int profileNumClients;
+static CARD64 profileStartTicks;
+static CARD64 profileStartMicros;
+
+static inline CARD64
+ProfileTicks(void)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_ia32_rdtsc();
+#else
+    return GetTimeInMicros();
+#endif
+}
+
+static void
+RequestProfileSignal(int signo)
+{
+    RequestProfileDumpPending = TRUE;
+}
+
+static void
+RequestProfileReset(void)
+{
+    int i;
+
+    memset(profileRequests, 0, 256 * 256 * sizeof(RequestProfileRec));
+    for (i = 0; i < profileNumClients; i++) {
+        free(profileClients[i].majors);
+        profileClients[i].majors = NULL;
+        profileClients[i].total.count = 0;
+        profileClients[i].total.ticks = 0;
+    }
+    profileStartMicros = GetTimeInMicros();
+    profileStartTicks = ProfileTicks();
+}
+
+static void
+RequestProfileClientState(CallbackListPtr *list, void *closure, void *data)
+{
+    NewClientInfoRec *clientinfo = (NewClientInfoRec *) data;
+    ClientPtr client = clientinfo->client;
+    ClientProfilePtr cp;
+
+    if (client->clientState != ClientStateInitial ||
+        client->index >= profileNumClients)
+        return;
+
+    /* The slot may have belonged to an earlier client */
+    cp = &profileClients[client->index];
+    free(cp->majors);
+    cp->majors = NULL;
+    cp->total.count = 0;
+    cp->total.ticks = 0;
+}
+
+/*****************
+ * InitRequestProfile
+ *    Called by Dispatch() every generation.  Allocates the tables and
+ *    installs the SIGUSR2 handler the first time -reqprofile is seen.
+ *****************/
+
+void
+InitRequestProfile(void)
+{
+    if (!RequestProfiling)
+        return;
+
+    if (!profileRequests) {
+        profileRequests = calloc(256 * 256, sizeof(RequestProfileRec));
+        profileClients = calloc(LimitClients, sizeof(ClientProfileRec));
+        if (!profileRequests || !profileClients) {
+            free(profileRequests);
+            free(profileClients);
+            profileRequests = NULL;
+            profileClients = NULL;
+            ErrorF("reqprofile: out of memory, request profiling disabled\n");
+            RequestProfiling = FALSE;
+            return;
+        }
+        profileNumClients = LimitClients;
+        RequestProfileReset();
+        OsSignal(SIGUSR2, RequestProfileSignal);
+        LogMessage(X_INFO, "Request profiling enabled, "
+                   "send SIGUSR2 to dump the profile\n");
+    }
+
+    AddCallback(&ClientStateCallback, RequestProfileClientState, NULL);
+}
+
+CARD64
+RequestProfileStart(void)
+{
+    return ProfileTicks();
+}
+
+/*****************
+ * RequestProfileRecord
+ *    Charges the time since start to the request the client just
+ *    dispatched.
+ *****************/
+
+void
+RequestProfileRecord(ClientPtr client, CARD64 start)
+{
+    CARD64 ticks = ProfileTicks() - start;
+    int major = client->majorOp;
+    RequestProfilePtr rp = &profileRequests[(major << 8) | client->minorOp];
+    ClientProfilePtr cp;
+
+    rp->count++;
+    rp->ticks += ticks;
+
+    if (client->index >= profileNumClients)
+        return;
+
+    cp = &profileClients[client->index];
+    cp->total.count++;
+    cp->total.ticks += ticks;
+    if (!cp->majors)
+        cp->majors = calloc(256, sizeof(RequestProfileRec));
+    if (cp->majors) {
+        cp->majors[major].count++;
+        cp->majors[major].ticks += ticks;
+    }
+}
+
+static const char *
+RequestProfileName(int major, int minor, char *buf, size_t len)
+{
+    ExtensionEntry *ext;
+
+#ifdef X_REGISTRY_REQUEST
+    const char *name = LookupRequestName(major, minor);
+
+    if (strcmp(name, XREGISTRY_UNKNOWN) != 0)
+        return name;
+#endif
+
+    if (major < EXTENSION_BASE)
+        snprintf(buf, len, "core:%d", major);
+    else if ((ext = GetExtensionEntry(major)))
+        snprintf(buf, len, "%s:%d", ext->name, minor);
+    else
+        snprintf(buf, len, "%d:%d", major, minor);
+    return buf;
+}
+
+/* Per client the time is only kept per major, name extensions as a whole */
+static const char *
+RequestProfileMajorName(int major, char *buf, size_t len)
+{
+    ExtensionEntry *ext;
+
+    if (major < EXTENSION_BASE)
+        return RequestProfileName(major, 0, buf, len);
+    if ((ext = GetExtensionEntry(major)))
+        return ext->name;
+    snprintf(buf, len, "%d", major);
+    return buf;
+}
+
+static RequestProfilePtr profileSortBase;
+
+static int
+RequestProfileCompare(const void *a, const void *b)
+{
+    CARD64 ta = profileSortBase[*(const int *) a].ticks;
+    CARD64 tb = profileSortBase[*(const int *) b].ticks;
+
+    return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+static int
+ClientProfileCompare(const void *a, const void *b)
+{
+    CARD64 ta = profileClients[*(const int *) a].total.ticks;
+    CARD64 tb = profileClients[*(const int *) b].total.ticks;
+
+    return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+/* Sorts the indices of the used entries in table by time, returns how many */
+static int
+RequestProfileSort(RequestProfilePtr table, int size, int *order)
+{
+    int i, n = 0;
+
+    for (i = 0; i < size; i++)
+        if (table[i].count)
+            order[n++] = i;
+    profileSortBase = table;
+    qsort(order, n, sizeof(int), RequestProfileCompare);
+    return n;
+}
+
+/*****************
+ * RequestProfileDump
+ *    Logs the requests and the clients that took the most time since
+ *    the last dump and starts a new profile.
+ *****************/
+
+void
+RequestProfileDump(void)
+{
+    CARD64 micros = GetTimeInMicros() - profileStartMicros;
+    double tpus;
+    CARD64 count = 0, ticks = 0;
+    int *order, majors[256];
+    int i, j, n;
+    char name[64];
+
+    RequestProfileDumpPending = FALSE;
+    if (!RequestProfiling)
+        return;
+
+    order = malloc(256 * 256 * sizeof(int));
+    if (!order)
+        return;
+
+    tpus = micros ? (double) (ProfileTicks() - profileStartTicks) / micros : 1.0;
+    if (tpus <= 0.0)
+        tpus = 1.0;
+
+    n = RequestProfileSort(profileRequests, 256 * 256, order);
+    for (i = 0; i < n; i++) {
+        count += profileRequests[order[i]].count;
+        ticks += profileRequests[order[i]].ticks;
+    }
+
+    LogMessage(X_INFO, "Request profile over %.3f s: %llu requests, "
+               "%.3f s in dispatch\n", micros / 1e6,
+               (unsigned long long) count, ticks / tpus / 1e6);
+
+    for (i = 0; i < n && i < PROFILE_TOP_REQUESTS; i++) {
+        RequestProfilePtr rp = &profileRequests[order[i]];
+
+        LogMessage(X_NONE, "  %-32s %10llu requests %12.0f us %9.1f us avg\n",
+                   RequestProfileName(order[i] >> 8, order[i] & 0xff,
+                                      name, sizeof(name)),
+                   (unsigned long long) rp->count, rp->ticks / tpus,
+                   rp->ticks / tpus / rp->count);
+    }
+
+    n = 0;
+    for (i = 0; i < profileNumClients; i++)
+        if (profileClients[i].total.count)
+            order[n++] = i;
+    qsort(order, n, sizeof(int), ClientProfileCompare);
+
+    for (i = 0; i < n && i < PROFILE_TOP_CLIENTS; i++) {
+        ClientProfilePtr cp = &profileClients[order[i]];
+        ClientPtr client = clients[order[i]];
+        const char *cmd = client ? GetClientCmdName(client) : NULL;
+        pid_t pid = client ? GetClientPid(client) : -1;
+        int m;
+
+        LogMessage(X_NONE, "  client %d (pid %ld, %s): %llu requests, "
+                   "%.0f us\n", order[i], (long) pid,
+                   cmd ? cmd : client ? "unknown" : "gone",
+                   (unsigned long long) cp->total.count,
+                   cp->total.ticks / tpus);
+
+        if (!cp->majors)
+            continue;
+        m = RequestProfileSort(cp->majors, 256, majors);
+        for (j = 0; j < m && j < PROFILE_CLIENT_REQUESTS; j++) {
+            RequestProfilePtr rp = &cp->majors[majors[j]];
+
+            LogMessage(X_NONE, "    %-30s %10llu requests %12.0f us\n",
+                       RequestProfileMajorName(majors[j], name, sizeof(name)),
+                       (unsigned long long) rp->count, rp->ticks / tpus);
+        }
+    }
+
+    free(order);
+    RequestProfileReset();
+}
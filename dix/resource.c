@@ -600,6 +600,23 @@ CreateNewResourceClass(void)
 
 static ClientResourceRec clientTable[MAXCLIENTS];
 
+/*****************
+ * ResourceClientBits
+ *    Returns the number of bits of an XID used for the client id. It is
+ *    derived from LimitClients the first time it is needed and must not
+ *    change afterwards, as existing XIDs would be split differently.
+ *****************/
+
+unsigned int
+ResourceClientBits(void)
+{
+    static unsigned int cached = 0;
+
+    if (cached == 0)
+        cached = Ones(LimitClients - 1);
+    return cached;
+}
+
 /*****************
  * InitClientResources
  *    When a new client is created, call this to allocate space
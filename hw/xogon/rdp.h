@@ -90,6 +90,21 @@ struct _rdpScreenInfoRec
 	int sizeInBytes;
 	char* pfbMemory;
 
+	/**
+	 * If zeroCopy is set the screen pixmap is backed by the ogon damage
+	 * buffer while a session is attached. fbShared tells if pfbMemory
+	 * currently points into the damage buffer (not owned by us) or to the
+	 * private framebuffer used while no session is connected.
+	 */
+	BOOL zeroCopy;
+	BOOL fbShared;
+
+	/* drop damaged tiles whose content did not change, see rdpTiles.c */
+	BOOL tileHash;
+
+	/* record screen to screen copies as moves, see rdpMove.c */
+	BOOL detectMoves;
+
 	int dpi;
 
 	int rdp_bpp;
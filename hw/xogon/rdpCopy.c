@@ -0,0 +1,481 @@
+/**
+ * ogon Remote Desktop Services
+ * X11 backend
+ *
+ * Copyright (C) 2013-2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Damage copy engine
+ *
+ * Copies damaged rectangles from the framebuffer into the ogon damage buffer.
+ * Large updates are split into row bands which are processed by a small pool
+ * of worker threads, the main thread takes part in the copy and returns once
+ * all bands are done. Both buffers always use the same scanline, so rects
+ * spanning the whole screen width are copied as one contiguous block.
+ *
+ * The destination is only read by ogon, on x86 the copy therefore uses
+ * non-temporal stores (AVX2 or SSE2, selected at runtime) to keep it out of
+ * the cache. Other architectures use memcpy.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define RDP_COPY_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+#include "rdpCopy.h"
+
+/* below this amount of bytes the copy is always done on the main thread */
+#define RDP_COPY_MT_THRESHOLD	(256 * 1024)
+
+/* minimum size of a single band */
+#define RDP_COPY_MIN_BAND	(64 * 1024)
+
+#define RDP_COPY_MAX_THREADS	32
+
+/* rows shorter than this are copied with memcpy, streaming them is slower */
+#define RDP_COPY_STREAM_MIN	1024
+
+/* smaller updates stay in the cache anyway, memcpy is faster for those */
+#define RDP_COPY_STREAM_TOTAL	(1024 * 1024)
+
+typedef void (*rdpCopyFunc)(char* dst, const char* src, size_t bytes);
+
+typedef struct _rdpCopyJob
+{
+	rdpCopyFunc copy;
+	char* dst;
+	const char* src;
+	int scanline;
+	int lineBytes;
+	int lines;
+} rdpCopyJob;
+
+static pthread_t g_copyThreads[RDP_COPY_MAX_THREADS];
+static int g_copyNumThreads = 0;
+static pthread_mutex_t g_copyLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_copyStartCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g_copyDoneCond = PTHREAD_COND_INITIALIZER;
+static int g_copyShutdown = 0;
+
+static rdpCopyJob* g_copyJobs = NULL;
+static int g_copyJobsSize = 0;
+static int g_copyStagedJobs = 0;
+static int g_copyNumJobs = 0;
+static int g_copyNextJob = 0;
+static int g_copyPendingJobs = 0;
+
+static void rdpCopyScalar(char* dst, const char* src, size_t bytes)
+{
+	memcpy(dst, src, bytes);
+}
+
+#ifdef RDP_COPY_HAVE_X86
+__attribute__((target("sse2")))
+static void rdpCopyStreamSSE2(char* dst, const char* src, size_t bytes)
+{
+	size_t head;
+	__m128i a, b, c, d;
+
+	if (bytes < RDP_COPY_STREAM_MIN)
+	{
+		memcpy(dst, src, bytes);
+		return;
+	}
+
+	head = (16 - ((uintptr_t) dst & 15)) & 15;
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	bytes -= head;
+
+	for (; bytes >= 64; bytes -= 64, src += 64, dst += 64)
+	{
+		a = _mm_loadu_si128((const __m128i*) src);
+		b = _mm_loadu_si128((const __m128i*) (src + 16));
+		c = _mm_loadu_si128((const __m128i*) (src + 32));
+		d = _mm_loadu_si128((const __m128i*) (src + 48));
+		_mm_stream_si128((__m128i*) dst, a);
+		_mm_stream_si128((__m128i*) (dst + 16), b);
+		_mm_stream_si128((__m128i*) (dst + 32), c);
+		_mm_stream_si128((__m128i*) (dst + 48), d);
+	}
+
+	for (; bytes >= 16; bytes -= 16, src += 16, dst += 16)
+		_mm_stream_si128((__m128i*) dst, _mm_loadu_si128((const __m128i*) src));
+
+	memcpy(dst, src, bytes);
+}
+
+__attribute__((target("avx2")))
+static void rdpCopyStreamAVX2(char* dst, const char* src, size_t bytes)
+{
+	size_t head;
+	__m256i a, b, c, d;
+
+	if (bytes < RDP_COPY_STREAM_MIN)
+	{
+		memcpy(dst, src, bytes);
+		return;
+	}
+
+	head = (32 - ((uintptr_t) dst & 31)) & 31;
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	bytes -= head;
+
+	for (; bytes >= 128; bytes -= 128, src += 128, dst += 128)
+	{
+		a = _mm256_loadu_si256((const __m256i*) src);
+		b = _mm256_loadu_si256((const __m256i*) (src + 32));
+		c = _mm256_loadu_si256((const __m256i*) (src + 64));
+		d = _mm256_loadu_si256((const __m256i*) (src + 96));
+		_mm256_stream_si256((__m256i*) dst, a);
+		_mm256_stream_si256((__m256i*) (dst + 32), b);
+		_mm256_stream_si256((__m256i*) (dst + 64), c);
+		_mm256_stream_si256((__m256i*) (dst + 96), d);
+	}
+
+	for (; bytes >= 32; bytes -= 32, src += 32, dst += 32)
+		_mm256_stream_si256((__m256i*) dst, _mm256_loadu_si256((const __m256i*) src));
+
+	memcpy(dst, src, bytes);
+}
+#endif
+
+static rdpCopyFunc g_copyFunc = rdpCopyScalar;
+static int g_copyKernel = RDP_COPY_KERNEL_SCALAR;
+
+static void rdpCopyRun(const rdpCopyJob* job)
+{
+	int i;
+	char* dst = job->dst;
+	const char* src = job->src;
+
+	if (job->lineBytes == job->scanline)
+	{
+		job->copy(dst, src, (size_t) job->lines * job->scanline);
+	}
+	else
+	{
+		for (i = 0; i < job->lines; i++)
+		{
+			job->copy(dst, src, job->lineBytes);
+			src += job->scanline;
+			dst += job->scanline;
+		}
+	}
+}
+
+/* streaming stores are weakly ordered, flush them before anyone is told */
+static void rdpCopyFence(rdpCopyFunc copy)
+{
+#ifdef RDP_COPY_HAVE_X86
+	if (copy != rdpCopyScalar)
+		_mm_sfence();
+#endif
+}
+
+/**
+ * Select the copy kernel, RDP_COPY_KERNEL_AUTO picks the best one the CPU
+ * supports. Returns the selected kernel which may differ from the requested
+ * one if that is not available.
+ */
+int rdpCopySetKernel(int kernel)
+{
+#ifdef RDP_COPY_HAVE_X86
+	__builtin_cpu_init();
+
+	if (kernel == RDP_COPY_KERNEL_AUTO || kernel == RDP_COPY_KERNEL_AVX2)
+	{
+		if (__builtin_cpu_supports("avx2"))
+		{
+			g_copyFunc = rdpCopyStreamAVX2;
+			g_copyKernel = RDP_COPY_KERNEL_AVX2;
+			return g_copyKernel;
+		}
+
+		kernel = RDP_COPY_KERNEL_SSE2;
+	}
+
+	if (kernel == RDP_COPY_KERNEL_SSE2 && __builtin_cpu_supports("sse2"))
+	{
+		g_copyFunc = rdpCopyStreamSSE2;
+		g_copyKernel = RDP_COPY_KERNEL_SSE2;
+		return g_copyKernel;
+	}
+#endif
+
+	g_copyFunc = rdpCopyScalar;
+	g_copyKernel = RDP_COPY_KERNEL_SCALAR;
+	return g_copyKernel;
+}
+
+const char* rdpCopyKernelName(int kernel)
+{
+	switch (kernel)
+	{
+		case RDP_COPY_KERNEL_SCALAR:
+			return "scalar";
+		case RDP_COPY_KERNEL_SSE2:
+			return "sse2";
+		case RDP_COPY_KERNEL_AVX2:
+			return "avx2";
+		default:
+			return "auto";
+	}
+}
+
+/* must be called with g_copyLock held, returns with g_copyLock held */
+static void rdpCopyProcessJobs(void)
+{
+	rdpCopyJob* job;
+
+	while (g_copyNextJob < g_copyNumJobs)
+	{
+		job = &g_copyJobs[g_copyNextJob++];
+
+		pthread_mutex_unlock(&g_copyLock);
+		rdpCopyRun(job);
+		rdpCopyFence(job->copy);
+		pthread_mutex_lock(&g_copyLock);
+
+		if (--g_copyPendingJobs == 0)
+			pthread_cond_signal(&g_copyDoneCond);
+	}
+}
+
+static void* rdpCopyThread(void* arg)
+{
+	pthread_mutex_lock(&g_copyLock);
+
+	while (!g_copyShutdown)
+	{
+		if (g_copyNextJob >= g_copyNumJobs)
+		{
+			pthread_cond_wait(&g_copyStartCond, &g_copyLock);
+			continue;
+		}
+
+		rdpCopyProcessJobs();
+	}
+
+	pthread_mutex_unlock(&g_copyLock);
+
+	return NULL;
+}
+
+static int rdpCopyAddJob(rdpCopyFunc copy, char* dst, const char* src, int scanline,
+		int lineBytes, int lines)
+{
+	rdpCopyJob* job;
+
+	if (g_copyStagedJobs >= g_copyJobsSize)
+	{
+		int size = g_copyJobsSize ? g_copyJobsSize * 2 : 64;
+		rdpCopyJob* jobs = (rdpCopyJob*) realloc(g_copyJobs, size * sizeof(rdpCopyJob));
+
+		if (!jobs)
+			return -1;
+
+		g_copyJobs = jobs;
+		g_copyJobsSize = size;
+	}
+
+	job = &g_copyJobs[g_copyStagedJobs++];
+	job->copy = copy;
+	job->dst = dst;
+	job->src = src;
+	job->scanline = scanline;
+	job->lineBytes = lineBytes;
+	job->lines = lines;
+
+	return 0;
+}
+
+int rdpCopyInit(int numThreads)
+{
+	int i;
+	sigset_t set, old;
+
+	if (g_copyNumThreads > 0)
+		return 0;
+
+	rdpCopySetKernel(RDP_COPY_KERNEL_AUTO);
+
+	/* the calling thread is the first worker */
+	numThreads--;
+
+	if (numThreads > RDP_COPY_MAX_THREADS)
+		numThreads = RDP_COPY_MAX_THREADS;
+
+	if (numThreads < 1)
+		return 0;
+
+	/* the workers must never handle any of the server's signals */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, &old);
+
+	g_copyShutdown = 0;
+
+	for (i = 0; i < numThreads; i++)
+	{
+		if (pthread_create(&g_copyThreads[i], NULL, rdpCopyThread, NULL) != 0)
+			break;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	g_copyNumThreads = i;
+
+	return (i == numThreads) ? 0 : -1;
+}
+
+void rdpCopyUninit(void)
+{
+	int i;
+
+	if (g_copyNumThreads < 1)
+		return;
+
+	pthread_mutex_lock(&g_copyLock);
+	g_copyShutdown = 1;
+	pthread_cond_broadcast(&g_copyStartCond);
+	pthread_mutex_unlock(&g_copyLock);
+
+	for (i = 0; i < g_copyNumThreads; i++)
+		pthread_join(g_copyThreads[i], NULL);
+
+	g_copyNumThreads = 0;
+
+	free(g_copyJobs);
+	g_copyJobs = NULL;
+	g_copyJobsSize = 0;
+	g_copyStagedJobs = 0;
+	g_copyNumJobs = 0;
+	g_copyNextJob = 0;
+}
+
+/* bytes to copy per line, the whole scanline if the rect spans the screen */
+static int rdpCopyLineBytes(const rdpCopyRect* rect, int width, int scanline, int bytesPerPixel)
+{
+	if (rect->x == 0 && rect->width >= width)
+		return scanline;
+
+	return rect->width * bytesPerPixel;
+}
+
+void rdpCopyRects(char* dst, const char* src, int width, int scanline, int bytesPerPixel,
+		const rdpCopyRect* rects, int numRects)
+{
+	int i, y, lines, bandLines, lineBytes, offset;
+	size_t totalBytes = 0;
+	size_t bandBytes;
+	rdpCopyFunc copy;
+
+	for (i = 0; i < numRects; i++)
+		totalBytes += (size_t) rects[i].width * bytesPerPixel * rects[i].height;
+
+	copy = (totalBytes >= RDP_COPY_STREAM_TOTAL) ? g_copyFunc : rdpCopyScalar;
+
+	g_copyStagedJobs = 0;
+
+	if (g_copyNumThreads > 0 && totalBytes >= RDP_COPY_MT_THRESHOLD)
+	{
+		/* aim for a few bands per thread so that uneven rects balance out */
+		bandBytes = totalBytes / ((g_copyNumThreads + 1) * 4);
+
+		if (bandBytes < RDP_COPY_MIN_BAND)
+			bandBytes = RDP_COPY_MIN_BAND;
+
+		for (i = 0; i < numRects; i++)
+		{
+			lineBytes = rdpCopyLineBytes(&rects[i], width, scanline, bytesPerPixel);
+
+			if (lineBytes < 1 || rects[i].height < 1)
+				continue;
+
+			bandLines = bandBytes / lineBytes;
+
+			if (bandLines < 1)
+				bandLines = 1;
+
+			for (y = 0; y < rects[i].height; y += bandLines)
+			{
+				lines = rects[i].height - y;
+
+				if (lines > bandLines)
+					lines = bandLines;
+
+				offset = (rects[i].y + y) * scanline + rects[i].x * bytesPerPixel;
+
+				if (rdpCopyAddJob(copy, dst + offset, src + offset, scanline, lineBytes, lines) < 0)
+				{
+					goto single_threaded;
+				}
+			}
+		}
+
+		/* publish the staged jobs to the workers */
+		pthread_mutex_lock(&g_copyLock);
+		g_copyNumJobs = g_copyStagedJobs;
+		g_copyNextJob = 0;
+		g_copyPendingJobs = g_copyNumJobs;
+		pthread_cond_broadcast(&g_copyStartCond);
+
+		rdpCopyProcessJobs();
+
+		while (g_copyPendingJobs > 0)
+			pthread_cond_wait(&g_copyDoneCond, &g_copyLock);
+
+		g_copyNumJobs = 0;
+		g_copyNextJob = 0;
+		pthread_mutex_unlock(&g_copyLock);
+
+		return;
+	}
+
+single_threaded:
+	for (i = 0; i < numRects; i++)
+	{
+		rdpCopyJob job;
+
+		offset = rects[i].y * scanline + rects[i].x * bytesPerPixel;
+
+		job.copy = copy;
+		job.dst = dst + offset;
+		job.src = src + offset;
+		job.scanline = scanline;
+		job.lineBytes = rdpCopyLineBytes(&rects[i], width, scanline, bytesPerPixel);
+		job.lines = rects[i].height;
+
+		rdpCopyRun(&job);
+	}
+
+	rdpCopyFence(copy);
+}
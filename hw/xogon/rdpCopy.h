@@ -0,0 +1,48 @@
+/**
+ * ogon Remote Desktop Services
+ * X11 backend
+ *
+ * Copyright (C) 2013-2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef OGON_X11RDP_COPY_H
+#define OGON_X11RDP_COPY_H
+
+typedef struct _rdpCopyRect
+{
+	int x;
+	int y;
+	int width;
+	int height;
+} rdpCopyRect;
+
+#define RDP_COPY_KERNEL_AUTO	0
+#define RDP_COPY_KERNEL_SCALAR	1
+#define RDP_COPY_KERNEL_SSE2	2
+#define RDP_COPY_KERNEL_AVX2	3
+
+int rdpCopyInit(int numThreads);
+void rdpCopyUninit(void);
+int rdpCopySetKernel(int kernel);
+const char* rdpCopyKernelName(int kernel);
+void rdpCopyRects(char* dst, const char* src, int width, int scanline, int bytesPerPixel,
+		const rdpCopyRect* rects, int numRects);
+
+#endif /* OGON_X11RDP_COPY_H */
@@ -0,0 +1,200 @@
+/**
+ * ogon Remote Desktop Services
+ * X11 backend
+ *
+ * Copyright (C) 2013-2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * Damage copy microbenchmark
+ *
+ * Compares the copy kernels of rdpCopy.c on typical damage patterns for
+ * 1080p and 4K framebuffers. Not built by default, use
+ * "make rdp-copy-bench" in hw/xogon.
+ *
+ * usage: rdp-copy-bench [threads] [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rdpCopy.h"
+
+#define BENCH_BPP	4
+#define BENCH_MAX_RECTS	512
+
+typedef struct _benchMix
+{
+	const char* name;
+	int (*fill)(rdpCopyRect* rects, int width, int height);
+} benchMix;
+
+static int benchFullScreen(rdpCopyRect* rects, int width, int height)
+{
+	rects[0].x = 0;
+	rects[0].y = 0;
+	rects[0].width = width;
+	rects[0].height = height;
+	return 1;
+}
+
+/* scrolling terminal or browser: a few full width bands */
+static int benchBands(rdpCopyRect* rects, int width, int height)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+	{
+		rects[i].x = 0;
+		rects[i].y = i * height / 4;
+		rects[i].width = width;
+		rects[i].height = height / 8;
+	}
+
+	return 4;
+}
+
+/* a window being repainted */
+static int benchWindow(rdpCopyRect* rects, int width, int height)
+{
+	rects[0].x = width / 8;
+	rects[0].y = height / 8;
+	rects[0].width = width * 3 / 4;
+	rects[0].height = height * 3 / 4;
+	return 1;
+}
+
+/* typing, blinking cursors, small widgets */
+static int benchSmall(rdpCopyRect* rects, int width, int height)
+{
+	int i;
+
+	srand(1);
+
+	for (i = 0; i < BENCH_MAX_RECTS; i++)
+	{
+		rects[i].width = 8 + rand() % 56;
+		rects[i].height = 8 + rand() % 24;
+		rects[i].x = rand() % (width - rects[i].width);
+		rects[i].y = rand() % (height - rects[i].height);
+	}
+
+	return BENCH_MAX_RECTS;
+}
+
+static const benchMix g_mixes[] =
+{
+	{ "full", benchFullScreen },
+	{ "bands", benchBands },
+	{ "window", benchWindow },
+	{ "small", benchSmall },
+};
+
+static double benchNow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void benchRun(int width, int height, int iterations)
+{
+	static const int kernels[] = {
+		RDP_COPY_KERNEL_SCALAR, RDP_COPY_KERNEL_SSE2, RDP_COPY_KERNEL_AVX2
+	};
+	rdpCopyRect rects[BENCH_MAX_RECTS];
+	int scanline = width * BENCH_BPP;
+	size_t size = (size_t) scanline * height;
+	char* src = malloc(size);
+	char* dst = malloc(size);
+	double start, elapsed, bytes;
+	unsigned m, k;
+	int i, n, kernel;
+
+	if (!src || !dst)
+	{
+		fprintf(stderr, "allocation failed\n");
+		exit(1);
+	}
+
+	memset(src, 0x5a, size);
+	memset(dst, 0, size);
+
+	for (m = 0; m < sizeof(g_mixes) / sizeof(g_mixes[0]); m++)
+	{
+		n = g_mixes[m].fill(rects, width, height);
+
+		bytes = 0;
+
+		for (i = 0; i < n; i++)
+			bytes += (double) rects[i].width * rects[i].height * BENCH_BPP;
+
+		for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+		{
+			kernel = rdpCopySetKernel(kernels[k]);
+
+			if (kernel != kernels[k])
+				continue;
+
+			/* warm up */
+			rdpCopyRects(dst, src, width, scanline, BENCH_BPP, rects, n);
+
+			start = benchNow();
+
+			for (i = 0; i < iterations; i++)
+				rdpCopyRects(dst, src, width, scanline, BENCH_BPP, rects, n);
+
+			elapsed = benchNow() - start;
+
+			printf("%4dx%-4d %-6s %-6s %4d rects %8.1f us/frame %7.2f GB/s\n",
+					width, height, g_mixes[m].name, rdpCopyKernelName(kernel), n,
+					elapsed * 1e6 / iterations, bytes * iterations / elapsed / 1e9);
+		}
+	}
+
+	free(src);
+	free(dst);
+}
+
+int main(int argc, char** argv)
+{
+	int threads = argc > 1 ? atoi(argv[1]) : 1;
+	int iterations = argc > 2 ? atoi(argv[2]) : 200;
+
+	if (threads < 1 || iterations < 1)
+	{
+		fprintf(stderr, "usage: %s [threads] [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	if (rdpCopyInit(threads) < 0)
+		fprintf(stderr, "failed to start all copy threads\n");
+
+	benchRun(1920, 1080, iterations);
+	benchRun(3840, 2160, iterations);
+
+	rdpCopyUninit();
+
+	return 0;
+}
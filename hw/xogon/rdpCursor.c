@@ -0,0 +1,189 @@
+/**
+ * ogon Remote Desktop Services
+ * X11 backend
+ *
+ * Copyright (C) 2013-2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+/**
+ * Pointer shape cache
+ *
+ * Converting an X cursor into an RDP pointer shape (bottom-up 32bpp XOR
+ * data plus 1bpp AND mask) is done once per cursor. Toolkits switch between
+ * a handful of cursors all the time when the pointer crosses windows, the
+ * converted shapes are kept here keyed by their CursorBits and colors.
+ *
+ * An entry is dropped when the CursorBits it was built from are about to be
+ * freed, so a new cursor allocated at the same address is never mistaken
+ * for a cached one. Every conversion gets a new serial which lets the
+ * caller tell whether the client already shows a shape.
+ */
+
+#include "rdp.h"
+#include "rdpCursor.h"
+#include "rdpCursorConvert.h"
+
+/* large enough for the frames of an animated cursor plus the static ones */
+#define RDP_CURSOR_CACHE_SIZE	64
+
+static rdpCursorShape* g_cursorCache[RDP_CURSOR_CACHE_SIZE];
+static UINT32 g_cursorSerial = 0;
+static UINT32 g_cursorClock = 0;
+
+static BOOL rdpCursorConvert(CursorPtr pCurs, rdpCursorShape* shape)
+{
+	CursorBitsPtr bits = pCurs->bits;
+	int cw = shape->width;
+	int ch = shape->height;
+
+	if (bits->argb)
+	{
+		rdpCursorConvertARGB(bits->argb, PixmapBytePad(bits->width, 32) / 4, cw, ch,
+				shape->xorMask, shape->andMask);
+	}
+	else
+	{
+		if (!bits->source)
+		{
+			ErrorF(("cursor bits are zero\n"));
+			return FALSE;
+		}
+
+		rdpCursorConvertMono(bits->source, bits->mask, BitmapBytePad(bits->width),
+				screenInfo.bitmapBitOrder == LSBFirst, shape->fg, shape->bg, cw, ch,
+				shape->xorMask, shape->andMask);
+	}
+
+	shape->xhot = bits->xhot;
+	shape->yhot = bits->yhot;
+
+	return TRUE;
+}
+
+/**
+ * Returns the converted shape of pCurs, converting it into the least
+ * recently used slot if it is not cached. The shape stays valid until the
+ * next call.
+ */
+rdpCursorShape* rdpCursorLookup(CursorPtr pCurs)
+{
+	rdpCursorShape* shape;
+	CARD32 fg = 0, bg = 0;
+	UINT32 oldest = 0xFFFFFFFF;
+	int i, slot = -1, lru = 0;
+	int cw, ch;
+	size_t xorLength, andLength;
+
+	if (!pCurs->bits->argb)
+	{
+		fg = GetColor(PIXEL_FORMAT_ARGB32, pCurs->foreRed, pCurs->foreGreen, pCurs->foreBlue, 0xff);
+		bg = GetColor(PIXEL_FORMAT_ARGB32, pCurs->backRed, pCurs->backGreen, pCurs->backBlue, 0xff);
+	}
+
+	g_cursorClock++;
+
+	for (i = 0; i < RDP_CURSOR_CACHE_SIZE; i++)
+	{
+		shape = g_cursorCache[i];
+
+		if (shape && shape->bits == pCurs->bits && shape->fg == fg && shape->bg == bg)
+		{
+			shape->lastUsed = g_cursorClock;
+			return shape;
+		}
+
+		if (!shape || !shape->bits)
+		{
+			slot = i;
+		}
+		else if (shape->lastUsed < oldest)
+		{
+			oldest = shape->lastUsed;
+			lru = i;
+		}
+	}
+
+	if (slot < 0)
+		slot = lru;
+
+	cw = MIN(pCurs->bits->width, RDP_CURSOR_MAX_SIZE);
+	ch = MIN(pCurs->bits->height, RDP_CURSOR_MAX_SIZE);
+	xorLength = (size_t) cw * ch * 4;
+	andLength = (size_t) ((cw + 15) >> 4) * 2 * ch;
+
+	shape = g_cursorCache[slot];
+
+	if (!shape || shape->capacity < xorLength + andLength)
+	{
+		if (!(shape = realloc(shape, sizeof(rdpCursorShape) + xorLength + andLength)))
+			return NULL;
+
+		shape->capacity = xorLength + andLength;
+		g_cursorCache[slot] = shape;
+	}
+
+	shape->bits = NULL;
+	shape->fg = fg;
+	shape->bg = bg;
+	shape->width = cw;
+	shape->height = ch;
+	shape->xorMask = (BYTE*) (shape + 1);
+	shape->andMask = shape->xorMask + xorLength;
+
+	if (!rdpCursorConvert(pCurs, shape))
+		return NULL;
+
+	shape->bits = pCurs->bits;
+	shape->serial = ++g_cursorSerial;
+	shape->lastUsed = g_cursorClock;
+
+	return shape;
+}
+
+/**
+ * Called when pCurs is unrealized. Its bits are freed right afterwards
+ * unless another cursor still references them.
+ */
+void rdpCursorForget(CursorPtr pCurs)
+{
+	int i;
+
+	if (!pCurs->bits || pCurs->bits->refcnt > 1)
+		return;
+
+	for (i = 0; i < RDP_CURSOR_CACHE_SIZE; i++)
+	{
+		if (g_cursorCache[i] && g_cursorCache[i]->bits == pCurs->bits)
+			g_cursorCache[i]->bits = NULL;
+	}
+}
+
+void rdpCursorUninit(void)
+{
+	int i;
+
+	for (i = 0; i < RDP_CURSOR_CACHE_SIZE; i++)
+	{
+		free(g_cursorCache[i]);
+		g_cursorCache[i] = NULL;
+	}
+}
@@ -0,0 +1,59 @@
+/**
+ * ogon Remote Desktop Services
+ * X11 backend
+ *
+ * Copyright (C) 2013-2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef OGON_X11RDP_CURSOR_H
+#define OGON_X11RDP_CURSOR_H
+
+/**
+ * The maximum allowed RDP pointer shape width and height is 96 pixels
+ * if the client indicated support for large pointers (LARGE_POINTER_FLAG),
+ * otherwise the maximum width and height is 32.
+ */
+#define RDP_CURSOR_MAX_SIZE	96
+
+typedef struct _rdpCursorShape
+{
+	CursorBitsPtr bits;
+	CARD32 fg;
+	CARD32 bg;
+	UINT32 serial;
+	UINT32 lastUsed;
+
+	int width;
+	int height;
+	int xhot;
+	int yhot;
+	BYTE* xorMask;
+	BYTE* andMask;
+
+	/* bytes allocated for the masks after the structure */
+	size_t capacity;
+} rdpCursorShape;
+
+rdpCursorShape* rdpCursorLookup(CursorPtr pCurs);
+void rdpCursorForget(CursorPtr pCurs);
+void rdpCursorUninit(void);
+
+#endif /* OGON_X11RDP_CURSOR_H */
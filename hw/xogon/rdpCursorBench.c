@@ -0,0 +1,229 @@
+/**
+ * ogon Remote Desktop Services
+ * X11 backend
+ *
+ * Copyright (C) 2013-2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * Pointer conversion microbenchmark
+ *
+ * Checks the converters of rdpCursorConvert.c against a straightforward
+ * per-pixel implementation and compares their speed for the usual cursor
+ * theme sizes. Not built by default, use "make rdp-cursor-bench" in
+ * hw/xogon.
+ *
+ * usage: rdp-cursor-bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rdpCursorConvert.h"
+
+#define BENCH_MAX_SIZE	96
+
+static const int g_sizes[] = { 24, 32, 48, 64, 96 };
+
+static uint32_t g_argb[BENCH_MAX_SIZE * BENCH_MAX_SIZE];
+static uint8_t g_source[BENCH_MAX_SIZE * BENCH_MAX_SIZE / 8];
+static uint8_t g_mask[BENCH_MAX_SIZE * BENCH_MAX_SIZE / 8];
+
+static uint8_t g_xorMask[2][BENCH_MAX_SIZE * BENCH_MAX_SIZE * 4];
+static uint8_t g_andMask[2][BENCH_MAX_SIZE * BENCH_MAX_SIZE / 8];
+
+static int benchAndStride(int width)
+{
+	return ((width + 15) >> 4) * 2;
+}
+
+static void benchSetAndBit(uint8_t* andMask, int x, int y, int width, int height)
+{
+	andMask[benchAndStride(width) * (height - 1 - y) + (x >> 3)] &= ~(0x80 >> (x & 7));
+}
+
+/* per pixel reference, bit order LSB first */
+static void benchReferenceARGB(const uint32_t* argb, int stride, int width, int height,
+		uint8_t* xorMask, uint8_t* andMask)
+{
+	uint32_t* dst = (uint32_t*) xorMask;
+	int x, y;
+
+	memset(xorMask, 0, (size_t) width * height * 4);
+	memset(andMask, 0xff, (size_t) benchAndStride(width) * height);
+
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+		{
+			uint32_t p = argb[y * stride + x];
+
+			if (p >> 24)
+			{
+				benchSetAndBit(andMask, x, y, width, height);
+				dst[(height - 1 - y) * width + x] = p;
+			}
+		}
+	}
+}
+
+static void benchReferenceMono(const uint8_t* source, const uint8_t* mask, int stride,
+		uint32_t fg, uint32_t bg, int width, int height, uint8_t* xorMask, uint8_t* andMask)
+{
+	uint32_t* dst = (uint32_t*) xorMask;
+	int x, y;
+
+	memset(xorMask, 0, (size_t) width * height * 4);
+	memset(andMask, 0xff, (size_t) benchAndStride(width) * height);
+
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+		{
+			int bit = 1 << (x & 7);
+
+			if (mask[y * stride + (x >> 3)] & bit)
+			{
+				benchSetAndBit(andMask, x, y, width, height);
+				dst[(height - 1 - y) * width + x] = (source[y * stride + (x >> 3)] & bit) ? fg : bg;
+			}
+		}
+	}
+}
+
+/* a round cursor with an antialiased edge and some transparent holes */
+static void benchFill(int size)
+{
+	int x, y, dx, dy, d;
+
+	srand(size);
+
+	for (y = 0; y < size; y++)
+	{
+		for (x = 0; x < size; x++)
+		{
+			dx = 2 * x - size;
+			dy = 2 * y - size;
+			d = dx * dx + dy * dy;
+
+			if (d < size * size && rand() % 8)
+				g_argb[y * size + x] = ((uint32_t) (rand() % 255 + 1) << 24) | (rand() & 0xffffff);
+			else
+				g_argb[y * size + x] = rand() & 0xffffff;
+		}
+	}
+
+	for (x = 0; x < (int) sizeof(g_source); x++)
+	{
+		g_source[x] = rand();
+		g_mask[x] = rand();
+	}
+}
+
+static double benchNow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int benchCompare(const char* name, int size)
+{
+	size_t xorLength = (size_t) size * size * 4;
+	size_t andLength = (size_t) benchAndStride(size) * size;
+
+	if (memcmp(g_xorMask[0], g_xorMask[1], xorLength) ||
+			memcmp(g_andMask[0], g_andMask[1], andLength))
+	{
+		fprintf(stderr, "%dx%d %s: output differs from the reference\n", size, size, name);
+		return 0;
+	}
+
+	return 1;
+}
+
+int main(int argc, char** argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+	int stride, size, i, k, failed = 0;
+	double start, reference, rows;
+	unsigned s;
+
+	if (iterations < 1)
+	{
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	for (s = 0; s < sizeof(g_sizes) / sizeof(g_sizes[0]); s++)
+	{
+		size = g_sizes[s];
+		stride = (size + 31) / 32 * 4;
+		benchFill(size);
+
+		for (k = 0; k < 2; k++)
+		{
+			const char* name = k ? "mono" : "argb";
+
+			start = benchNow();
+
+			for (i = 0; i < iterations; i++)
+			{
+				if (k)
+					benchReferenceMono(g_source, g_mask, stride, 0xffffffff, 0xff000000,
+							size, size, g_xorMask[0], g_andMask[0]);
+				else
+					benchReferenceARGB(g_argb, size, size, size, g_xorMask[0], g_andMask[0]);
+			}
+
+			reference = benchNow() - start;
+
+			/* poison the output, every byte has to be written */
+			memset(g_xorMask[1], 0x5a, sizeof(g_xorMask[1]));
+			memset(g_andMask[1], 0x5a, sizeof(g_andMask[1]));
+
+			start = benchNow();
+
+			for (i = 0; i < iterations; i++)
+			{
+				if (k)
+					rdpCursorConvertMono(g_source, g_mask, stride, 1, 0xffffffff, 0xff000000,
+							size, size, g_xorMask[1], g_andMask[1]);
+				else
+					rdpCursorConvertARGB(g_argb, size, size, size, g_xorMask[1], g_andMask[1]);
+			}
+
+			rows = benchNow() - start;
+
+			if (!benchCompare(name, size))
+				failed = 1;
+
+			printf("%2dx%-2d %s  reference %7.2f us  rows %7.2f us  %5.1fx\n",
+					size, size, name, reference * 1e6 / iterations,
+					rows * 1e6 / iterations, reference / rows);
+		}
+	}
+
+	return failed;
+}
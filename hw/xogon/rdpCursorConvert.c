@@ -0,0 +1,227 @@
+/**
+ * ogon Remote Desktop Services
+ * X11 backend
+ *
+ * Copyright (C) 2013-2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * Pointer shape conversion
+ *
+ * Converts X cursor images into the RDP pointer format: 32bpp XOR data and
+ * a 1bpp AND mask (MS-RDPBCGR 2.2.9.1.1.4.4), both bottom-up. The AND mask
+ * rows are padded to 2 bytes and its bits are MSB first. Pixels which are
+ * transparent in the X cursor get a set AND bit and zero XOR data.
+ *
+ * Both converters work on whole rows and 8 pixels (one AND mask byte) at a
+ * time. The ARGB alpha test uses SSE2 where available. Neither depends on
+ * the X server so they can be benchmarked standalone, see rdpCursorBench.c.
+ */
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "rdpCursorConvert.h"
+
+/* bit order reversal of a nibble */
+static const uint8_t g_reverseNibble[16] =
+{
+	0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe,
+	0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf
+};
+
+#define RDP_REVERSE_BYTE(_b) \
+	((uint8_t) ((g_reverseNibble[(_b) & 0xf] << 4) | g_reverseNibble[(_b) >> 4]))
+
+static int rdpCursorAndStride(int width)
+{
+	return ((width + 15) >> 4) * 2;
+}
+
+/**
+ * Converts up to 8 pixels, returns the transparency bits with pixel i in
+ * bit i.
+ */
+static inline unsigned rdpCursorARGB8(const uint32_t* src, uint32_t* dst, int n)
+{
+	unsigned transparent = 0;
+	int i = 0;
+
+#if defined(__SSE2__)
+	if (n == 8)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i lo = _mm_loadu_si128((const __m128i*) src);
+		__m128i hi = _mm_loadu_si128((const __m128i*) (src + 4));
+		__m128i tlo = _mm_cmpeq_epi32(_mm_srli_epi32(lo, 24), zero);
+		__m128i thi = _mm_cmpeq_epi32(_mm_srli_epi32(hi, 24), zero);
+
+		_mm_storeu_si128((__m128i*) dst, _mm_andnot_si128(tlo, lo));
+		_mm_storeu_si128((__m128i*) (dst + 4), _mm_andnot_si128(thi, hi));
+
+		return (unsigned) _mm_movemask_ps(_mm_castsi128_ps(tlo)) |
+				((unsigned) _mm_movemask_ps(_mm_castsi128_ps(thi)) << 4);
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		if (src[i] >> 24)
+		{
+			dst[i] = src[i];
+		}
+		else
+		{
+			dst[i] = 0;
+			transparent |= 1 << i;
+		}
+	}
+
+	return transparent;
+}
+
+/**
+ * Converts the top left width x height pixels of an ARGB cursor, stride is
+ * in pixels.
+ */
+void rdpCursorConvertARGB(const uint32_t* argb, int stride, int width, int height,
+		uint8_t* xorMask, uint8_t* andMask)
+{
+	int andStride = rdpCursorAndStride(width);
+	int x, y, n;
+	unsigned transparent;
+
+	for (y = 0; y < height; y++)
+	{
+		const uint32_t* src = argb + (size_t) y * stride;
+		uint32_t* dst = (uint32_t*) xorMask + (size_t) (height - 1 - y) * width;
+		uint8_t* andLine = andMask + (size_t) (height - 1 - y) * andStride;
+
+		for (x = 0; x < width; x += 8)
+		{
+			n = width - x < 8 ? width - x : 8;
+			transparent = rdpCursorARGB8(src + x, dst + x, n);
+
+			/* bits past the width stay set */
+			transparent |= 0xff << n;
+			*andLine++ = RDP_REVERSE_BYTE(transparent & 0xff);
+		}
+
+		if (((width + 7) >> 3) < andStride)
+			*andLine = 0xff;
+	}
+}
+
+/* g_bitLanes[b][i] is all ones if bit i (MSB first) of b is set */
+static uint32_t g_bitLanes[256][8];
+static int g_bitLanesInitialized = 0;
+
+static void rdpCursorInitBitLanes(void)
+{
+	int b, i;
+
+	for (b = 0; b < 256; b++)
+	{
+		for (i = 0; i < 8; i++)
+			g_bitLanes[b][i] = (b & (0x80 >> i)) ? 0xffffffff : 0;
+	}
+
+	g_bitLanesInitialized = 1;
+}
+
+/* expands 8 pixels of a source and mask byte (MSB first) */
+static inline void rdpCursorMono8(uint8_t s, uint8_t m, uint32_t fg, uint32_t bg, uint32_t* dst, int n)
+{
+	const uint32_t* sl = g_bitLanes[s];
+	const uint32_t* ml = g_bitLanes[m];
+	int i = 0;
+
+#if defined(__SSE2__)
+	if (n == 8)
+	{
+		const __m128i vfg = _mm_set1_epi32((int) fg);
+		const __m128i vbg = _mm_set1_epi32((int) bg);
+
+		for (; i < 8; i += 4)
+		{
+			__m128i vs = _mm_loadu_si128((const __m128i*) (sl + i));
+			__m128i vm = _mm_loadu_si128((const __m128i*) (ml + i));
+			__m128i px = _mm_or_si128(_mm_and_si128(vs, vfg), _mm_andnot_si128(vs, vbg));
+
+			_mm_storeu_si128((__m128i*) (dst + i), _mm_and_si128(px, vm));
+		}
+
+		return;
+	}
+#endif
+
+	for (; i < n; i++)
+		dst[i] = ((sl[i] & fg) | (~sl[i] & bg)) & ml[i];
+}
+
+/**
+ * Converts the top left width x height pixels of a two color cursor,
+ * stride is in bytes. Pixels outside the mask are transparent, the others
+ * get fg or bg depending on the source bit.
+ */
+void rdpCursorConvertMono(const uint8_t* source, const uint8_t* mask, int stride,
+		int lsbFirst, uint32_t fg, uint32_t bg, int width, int height,
+		uint8_t* xorMask, uint8_t* andMask)
+{
+	int andStride = rdpCursorAndStride(width);
+	int x, y, n;
+	uint8_t s, m;
+
+	if (!g_bitLanesInitialized)
+		rdpCursorInitBitLanes();
+
+	for (y = 0; y < height; y++)
+	{
+		const uint8_t* srcLine = source + (size_t) y * stride;
+		const uint8_t* mskLine = mask + (size_t) y * stride;
+		uint32_t* dst = (uint32_t*) xorMask + (size_t) (height - 1 - y) * width;
+		uint8_t* andLine = andMask + (size_t) (height - 1 - y) * andStride;
+
+		for (x = 0; x < width; x += 8)
+		{
+			n = width - x < 8 ? width - x : 8;
+			s = *srcLine++;
+			m = *mskLine++;
+
+			if (lsbFirst)
+			{
+				s = RDP_REVERSE_BYTE(s);
+				m = RDP_REVERSE_BYTE(m);
+			}
+
+			/* bits past the width stay set */
+			*andLine++ = (uint8_t) ~m | (0xff >> n);
+
+			rdpCursorMono8(s, m, fg, bg, dst + x, n);
+		}
+
+		if (((width + 7) >> 3) < andStride)
+			*andLine = 0xff;
+	}
+}
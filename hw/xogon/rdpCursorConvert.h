@@ -0,0 +1,37 @@
+/**
+ * ogon Remote Desktop Services
+ * X11 backend
+ *
+ * Copyright (C) 2013-2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef OGON_X11RDP_CURSOR_CONVERT_H
+#define OGON_X11RDP_CURSOR_CONVERT_H
+
+#include <stdint.h>
+
+void rdpCursorConvertARGB(const uint32_t* argb, int stride, int width, int height,
+		uint8_t* xorMask, uint8_t* andMask);
+void rdpCursorConvertMono(const uint8_t* source, const uint8_t* mask, int stride,
+		int lsbFirst, uint32_t fg, uint32_t bg, int width, int height,
+		uint8_t* xorMask, uint8_t* andMask);
+
+#endif /* OGON_X11RDP_CURSOR_CONVERT_H */
@@ -0,0 +1,146 @@
+/**
+ * ogon Remote Desktop Services
+ * X11 backend
+ *
+ * Copyright (C) 2013-2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * Frame scheduler
+ *
+ * Limits how often damage is handed to ogon. After a frame was sent the
+ * next one is held back until the frame interval has passed, damage drawn
+ * in the meantime is aggregated into that frame. A timer makes sure the
+ * pending frame is sent once the interval is over, even if the server is
+ * idle by then.
+ *
+ * The interval backs off when ogon takes longer than the interval to
+ * request the next frame (the encoder or network is the bottleneck) and
+ * slowly returns to the configured rate once ogon keeps up again.
+ */
+
+#include "rdp.h"
+#include "rdpFrame.h"
+
+/* the interval never backs off beyond this */
+#define RDP_FRAME_MAX_INTERVAL	250
+
+static CARD32 g_frameBaseInterval = 0;
+static CARD32 g_frameInterval = 0;
+static CARD32 g_frameLastSent = 0;
+static BOOL g_frameAwaitingRequest = FALSE;
+static OsTimerPtr g_frameTimer = NULL;
+static BOOL g_frameTimerArmed = FALSE;
+
+static CARD32 rdpFrameTimerCallback(OsTimerPtr timer, CARD32 now, void* arg)
+{
+	g_frameTimerArmed = FALSE;
+	rdp_handle_damage_region(2);
+
+	return 0;
+}
+
+/* fps of 0 disables the scheduler, frames are sent as soon as requested */
+void rdpFrameInit(int fps)
+{
+	/* armed timers were already freed by TimerInit() on server reset */
+	if (g_frameTimer && !g_frameTimerArmed)
+		TimerFree(g_frameTimer);
+
+	g_frameTimer = NULL;
+	g_frameTimerArmed = FALSE;
+
+	g_frameBaseInterval = (fps > 0) ? 1000 / fps : 0;
+	g_frameInterval = g_frameBaseInterval;
+	g_frameLastSent = GetTimeInMillis() - g_frameInterval;
+	g_frameAwaitingRequest = FALSE;
+}
+
+void rdpFrameUninit(void)
+{
+	if (g_frameTimer)
+		TimerFree(g_frameTimer);
+
+	g_frameTimer = NULL;
+	g_frameTimerArmed = FALSE;
+}
+
+/**
+ * Tells if a frame may be sent now. If not the timer is armed to retry once
+ * the frame interval is over.
+ */
+BOOL rdpFrameReady(void)
+{
+	CARD32 elapsed;
+
+	if (!g_frameBaseInterval)
+		return TRUE;
+
+	elapsed = GetTimeInMillis() - g_frameLastSent;
+
+	if (elapsed >= g_frameInterval)
+		return TRUE;
+
+	if (!g_frameTimerArmed)
+	{
+		g_frameTimer = TimerSet(g_frameTimer, 0, g_frameInterval - elapsed,
+				rdpFrameTimerCallback, NULL);
+		g_frameTimerArmed = (g_frameTimer != NULL);
+	}
+
+	return FALSE;
+}
+
+void rdpFrameSent(void)
+{
+	g_frameLastSent = GetTimeInMillis();
+	g_frameAwaitingRequest = TRUE;
+
+	if (g_frameTimerArmed)
+	{
+		TimerCancel(g_frameTimer);
+		g_frameTimerArmed = FALSE;
+	}
+}
+
+/* ogon asked for the next frame, adapt the interval to its pace */
+void rdpFrameRequested(void)
+{
+	CARD32 delay;
+
+	if (!g_frameBaseInterval || !g_frameAwaitingRequest)
+		return;
+
+	g_frameAwaitingRequest = FALSE;
+	delay = GetTimeInMillis() - g_frameLastSent;
+
+	if (delay > g_frameInterval)
+	{
+		g_frameInterval += g_frameInterval / 2 + 1;
+
+		if (g_frameInterval > RDP_FRAME_MAX_INTERVAL)
+			g_frameInterval = RDP_FRAME_MAX_INTERVAL;
+	}
+	else if (g_frameInterval > g_frameBaseInterval)
+	{
+		g_frameInterval -= (g_frameInterval - g_frameBaseInterval + 7) / 8;
+	}
+}
@@ -0,0 +1,478 @@
+/**
+ * ogon Remote Desktop Services
+ * X11 backend
+ *
+ * Copyright (C) 2013-2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * Process launcher
+ *
+ * Forking the X server to run a command means copying its page tables on
+ * the main thread, which gets slow with a large heap. Instead a small helper
+ * is forked once and started programs are spawned from there. Requests and
+ * replies are packets on a SOCK_SEQPACKET socket pair, so the server never
+ * blocks on fork or waitpid.
+ *
+ * A request is an rdpHelperRequest followed by argc NUL terminated
+ * arguments and envc NUL terminated environment entries. The helper is
+ * forked before the display is set up and the server may change DISPLAY
+ * later (-standby), so every request carries the server's current value
+ * of the variables in rdpHelperEnvNames. An entry without '=' removes the
+ * variable. If the request asks to wait, the helper reports the exit code
+ * of the program as an rdpHelperReply with the request id.
+ */
+
+#include "rdp.h"
+#include "rdpHelper.h"
+
+#include <dirent.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define RDP_HELPER_MAX_PACKET	(64 * 1024)
+#define RDP_HELPER_MAX_ARGS	32
+#define RDP_HELPER_MAX_ENV	8
+
+typedef struct _rdpHelperRequest
+{
+	UINT32 id;
+	UINT32 wait;
+	UINT32 argc;
+	UINT32 envc;
+} rdpHelperRequest;
+
+typedef struct _rdpHelperReply
+{
+	UINT32 id;
+	INT32 result;
+} rdpHelperReply;
+
+extern char** environ;
+
+static int g_helperFd = -1;
+static pid_t g_helperPid = -1;
+static rdpHelperReplyProc g_replyProc = NULL;
+
+/* variables passed from the server with every request */
+static const char* rdpHelperEnvNames[] = { "DISPLAY", "XAUTHORITY", NULL };
+
+/* length of the variable name of an environment entry */
+static size_t rdpHelperEnvNameLength(const char* entry)
+{
+	const char* end = strchr(entry, '=');
+
+	return end ? (size_t) (end - entry) : strlen(entry);
+}
+
+/**
+ * Build the environment of a program: the helper's own environment with
+ * the entries named in env replaced by env. Entries of env without '='
+ * only remove the variable. Returns NULL if out of memory.
+ */
+static char** rdpHelperBuildEnv(char* const env[])
+{
+	char** envp;
+	size_t count, length;
+	int i, j, n = 0;
+
+	for (count = 0; environ[count]; count++);
+	for (i = 0; env[i]; i++);
+
+	if (!(envp = calloc(count + i + 1, sizeof(char*))))
+		return NULL;
+
+	for (i = 0; environ[i]; i++)
+	{
+		length = rdpHelperEnvNameLength(environ[i]);
+
+		for (j = 0; env[j]; j++)
+		{
+			if (rdpHelperEnvNameLength(env[j]) == length &&
+					strncmp(environ[i], env[j], length) == 0)
+			{
+				break;
+			}
+		}
+
+		if (!env[j])
+			envp[n++] = environ[i];
+	}
+
+	for (j = 0; env[j]; j++)
+	{
+		if (strchr(env[j], '='))
+			envp[n++] = env[j];
+	}
+
+	envp[n] = NULL;
+	return envp;
+}
+
+static int rdpHelperRun(char* const argv[], char* const env[])
+{
+	posix_spawnattr_t attr;
+	sigset_t signals;
+	char** envp;
+	pid_t pid;
+	int status;
+
+	if (!(envp = rdpHelperBuildEnv(env)))
+	{
+		fprintf(stderr, "ogon-backend-x helper: unable to run %s: out of memory\n", argv[0]);
+		return -1;
+	}
+
+	/* the helper ignores SIGCHLD, programs must start with the default */
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGCHLD);
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setsigdefault(&attr, &signals);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+
+	status = posix_spawnp(&pid, argv[0], NULL, &attr, argv, envp);
+	posix_spawnattr_destroy(&attr);
+	free(envp);
+
+	if (status != 0)
+	{
+		fprintf(stderr, "ogon-backend-x helper: unable to run %s: %s\n", argv[0], strerror(status));
+		return -1;
+	}
+
+	return pid;
+}
+
+static void rdpHelperWait(int fd, UINT32 id, pid_t pid)
+{
+	rdpHelperReply reply;
+	int status;
+
+	reply.id = id;
+	reply.result = -1;
+
+	if (pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status))
+	{
+		reply.result = WEXITSTATUS(status);
+
+		if (reply.result == 255)
+			reply.result = -1;
+	}
+
+	send(fd, &reply, sizeof(reply), MSG_NOSIGNAL);
+}
+
+static void __attribute__((__noreturn__)) rdpHelperMain(int fd)
+{
+	char packet[RDP_HELPER_MAX_PACKET + 1];
+	char* argv[RDP_HELPER_MAX_ARGS + 1];
+	char* env[RDP_HELPER_MAX_ENV + 1];
+	rdpHelperRequest* request = (rdpHelperRequest*) packet;
+	char* arg;
+	ssize_t length;
+	UINT32 i;
+	pid_t pid;
+
+	/* finished programs and waiters are reaped automatically */
+	signal(SIGCHLD, SIG_IGN);
+
+	while ((length = recv(fd, packet, RDP_HELPER_MAX_PACKET, 0)) > 0)
+	{
+		if (length < (ssize_t) sizeof(rdpHelperRequest) || request->argc < 1 ||
+				request->argc > RDP_HELPER_MAX_ARGS || request->envc > RDP_HELPER_MAX_ENV)
+		{
+			continue;
+		}
+
+		packet[length] = '\0';
+		arg = packet + sizeof(rdpHelperRequest);
+
+		for (i = 0; i < request->argc && arg < packet + length; i++)
+		{
+			argv[i] = arg;
+			arg += strlen(arg) + 1;
+		}
+
+		if (i < request->argc)
+			continue;
+
+		argv[i] = NULL;
+
+		for (i = 0; i < request->envc && arg < packet + length; i++)
+		{
+			env[i] = arg;
+			arg += strlen(arg) + 1;
+		}
+
+		if (i < request->envc)
+			continue;
+
+		env[i] = NULL;
+
+		if (!request->wait)
+		{
+			rdpHelperRun(argv, env);
+			continue;
+		}
+
+		/* a message box may stay open for minutes, wait in a child */
+		pid = fork();
+
+		if (pid == 0)
+		{
+			/* the program must not be reaped before waitpid */
+			signal(SIGCHLD, SIG_DFL);
+			rdpHelperWait(fd, request->id, rdpHelperRun(argv, env));
+			_exit(0);
+		}
+		else if (pid < 0)
+		{
+			rdpHelperWait(fd, request->id, -1);
+		}
+	}
+
+	_exit(0);
+}
+
+/* close all fds from first to last, returns FALSE if close_range is missing */
+static BOOL rdpHelperCloseRange(unsigned int first, unsigned int last)
+{
+	if (first > last)
+		return TRUE;
+
+#ifdef SYS_close_range
+	return syscall(SYS_close_range, first, last, 0) == 0;
+#else
+	return FALSE;
+#endif
+}
+
+/**
+ * Close every fd from 3 on except keep. With a raised RLIMIT_NOFILE a loop
+ * up to _SC_OPEN_MAX would take up to a million system calls, so the open
+ * fds are closed with close_range or looked up in /proc/self/fd instead.
+ */
+static void rdpHelperCloseFds(int keep)
+{
+	struct dirent* entry;
+	DIR* dir;
+	int fd, maxFd;
+
+	if (rdpHelperCloseRange(3, keep - 1) && rdpHelperCloseRange(keep + 1, ~0U))
+		return;
+
+	if ((dir = opendir("/proc/self/fd")))
+	{
+		while ((entry = readdir(dir)))
+		{
+			fd = atoi(entry->d_name);
+
+			if (fd > 2 && fd != keep && fd != dirfd(dir))
+				close(fd);
+		}
+
+		closedir(dir);
+		return;
+	}
+
+	maxFd = sysconf(_SC_OPEN_MAX);
+
+	for (fd = 3; fd < maxFd; fd++)
+	{
+		if (fd != keep)
+			close(fd);
+	}
+}
+
+static void rdpHelperNotify(int fd, int ready, void* data)
+{
+	rdpHelperReply reply;
+	ssize_t length;
+
+	while ((length = recv(fd, &reply, sizeof(reply), MSG_DONTWAIT)) == sizeof(reply))
+	{
+		if (g_replyProc)
+			g_replyProc(reply.id, reply.result);
+	}
+
+	if (length == 0 || (length < 0 && errno != EAGAIN && errno != EINTR))
+	{
+		ErrorF("rdpHelperNotify: helper exited\n");
+		rdpHelperStop();
+	}
+}
+
+static BOOL rdpHelperStart(void)
+{
+	int fds[2];
+	pid_t pid;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) != 0)
+	{
+		ErrorF("rdpHelperStart: socketpair failed: %s\n", strerror(errno));
+		return FALSE;
+	}
+
+	pid = fork();
+
+	if (pid < 0)
+	{
+		ErrorF("rdpHelperStart: fork failed: %s\n", strerror(errno));
+		close(fds[0]);
+		close(fds[1]);
+		return FALSE;
+	}
+
+	if (pid == 0)
+	{
+		sigset_t signals;
+
+		/* drop the server's signal handlers */
+		sigemptyset(&signals);
+		sigprocmask(SIG_SETMASK, &signals, NULL);
+		signal(SIGHUP, SIG_DFL);
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+		signal(SIGUSR1, SIG_DFL);
+		signal(SIGUSR2, SIG_DFL);
+
+		/* keep nothing of the server open, in particular client connections */
+		rdpHelperCloseFds(fds[1]);
+		rdpHelperMain(fds[1]);
+	}
+
+	close(fds[1]);
+
+	g_helperFd = fds[0];
+	g_helperPid = pid;
+	SetNotifyFd(g_helperFd, rdpHelperNotify, X_NOTIFY_READ, NULL);
+
+	return TRUE;
+}
+
+/**
+ * Fork the helper while the server heap is still small. Called from
+ * InitOutput, rdpHelperSpawn starts it again if it went away.
+ */
+void rdpHelperInit(void)
+{
+	if (g_helperFd < 0)
+		rdpHelperStart();
+}
+
+/* append name=value, or only name if the server has no such variable */
+static BOOL rdpHelperAppendEnv(char* packet, size_t* length, const char* name)
+{
+	const char* value = getenv(name);
+	int size;
+
+	if (value)
+		size = snprintf(packet + *length, RDP_HELPER_MAX_PACKET - *length, "%s=%s", name, value);
+	else
+		size = snprintf(packet + *length, RDP_HELPER_MAX_PACKET - *length, "%s", name);
+
+	if (size < 0 || *length + size + 1 > RDP_HELPER_MAX_PACKET)
+		return FALSE;
+
+	*length += size + 1;
+	return TRUE;
+}
+
+/**
+ * Run argv[0] (searched in PATH) with the given arguments and the server's
+ * current DISPLAY and XAUTHORITY. If wait is set the exit code is passed to
+ * the reply handler with id, -1 if the program could not be run or did not
+ * exit normally.
+ */
+BOOL rdpHelperSpawn(char* const argv[], UINT32 id, BOOL wait)
+{
+	char packet[RDP_HELPER_MAX_PACKET];
+	rdpHelperRequest* request = (rdpHelperRequest*) packet;
+	size_t length = sizeof(rdpHelperRequest);
+	size_t size;
+	int i, j;
+
+	for (i = 0; argv[i]; i++)
+	{
+		size = strlen(argv[i]) + 1;
+
+		if (i == RDP_HELPER_MAX_ARGS || length + size > RDP_HELPER_MAX_PACKET)
+		{
+			ErrorF("rdpHelperSpawn: command line of %s too long\n", argv[0]);
+			return FALSE;
+		}
+
+		memcpy(packet + length, argv[i], size);
+		length += size;
+	}
+
+	for (j = 0; rdpHelperEnvNames[j]; j++)
+	{
+		if (!rdpHelperAppendEnv(packet, &length, rdpHelperEnvNames[j]))
+		{
+			ErrorF("rdpHelperSpawn: environment of %s too long\n", argv[0]);
+			return FALSE;
+		}
+	}
+
+	request->id = id;
+	request->wait = wait ? 1 : 0;
+	request->argc = i;
+	request->envc = j;
+
+	if (g_helperFd < 0 && !rdpHelperStart())
+		return FALSE;
+
+	if (send(g_helperFd, packet, length, MSG_NOSIGNAL) != (ssize_t) length)
+	{
+		ErrorF("rdpHelperSpawn: helper not responding: %s\n", strerror(errno));
+		rdpHelperStop();
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void rdpHelperSetReplyHandler(rdpHelperReplyProc proc)
+{
+	g_replyProc = proc;
+}
+
+void rdpHelperStop(void)
+{
+	int status;
+
+	if (g_helperFd < 0)
+		return;
+
+	RemoveNotifyFd(g_helperFd);
+	close(g_helperFd);
+	g_helperFd = -1;
+
+	/* the helper exits when the socket is closed */
+	if (g_helperPid > 0)
+		waitpid(g_helperPid, &status, 0);
+
+	g_helperPid = -1;
+}
@@ -38,10 +38,14 @@
 
 #include "input.h"
 #include "inpututils.h"
+#include "picturestr.h"
 
 #include <winpr/input.h>
 
 #include "rdpInput.h"
+#include "rdpStats.h"
+#include "rdpCursor.h"
+#include "rdpKeymap.h"
 #include <xkbsrv.h>
 
 
@@ -60,47 +64,84 @@ extern DeviceIntPtr g_pointer;
 extern DeviceIntPtr g_keyboard;
 extern DeviceIntPtr g_multitouch;
 extern rdpScreenInfoRec g_rdpScreen;
+extern ScreenPtr g_pScreen;
 extern int g_nokpcursors;
+extern int g_motionCoalesce;
+extern int g_rawMotionHistory;
 extern int g_active;
 
 static int g_old_button_mask = 0;
 
-/* Copied from Xvnc/lib/font/util/utilbitmap.c */
-static unsigned char g_reverse_byte[0x100] =
+/* serial of the pointer shape shown by the client, 0 if unknown */
+static UINT32 g_pointerSerial = 0;
+
+/**
+ * Absolute motion which has not been injected yet. Clients send many
+ * motions per wakeup, only the last position of a run is turned into a
+ * pointer event, see PtrFlushMotionEvents.
+ */
+static Bool g_motionPending = FALSE;
+static int g_motionX = 0;
+static int g_motionY = 0;
+
+/**
+ * Unicode key events which have not been injected yet. They are collected
+ * per wakeup so that all keysyms they need are mapped at once, see
+ * KbdFlushUnicodeEvents. A run of them and a pending motion never exist at
+ * the same time, adding either one flushes the other, so the input order
+ * is kept.
+ */
+#define RDP_UNICODE_PENDING	32
+
+typedef struct
 {
-	0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0,
-	0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0,
-	0x08, 0x88, 0x48, 0xc8, 0x28, 0xa8, 0x68, 0xe8,
-	0x18, 0x98, 0x58, 0xd8, 0x38, 0xb8, 0x78, 0xf8,
-	0x04, 0x84, 0x44, 0xc4, 0x24, 0xa4, 0x64, 0xe4,
-	0x14, 0x94, 0x54, 0xd4, 0x34, 0xb4, 0x74, 0xf4,
-	0x0c, 0x8c, 0x4c, 0xcc, 0x2c, 0xac, 0x6c, 0xec,
-	0x1c, 0x9c, 0x5c, 0xdc, 0x3c, 0xbc, 0x7c, 0xfc,
-	0x02, 0x82, 0x42, 0xc2, 0x22, 0xa2, 0x62, 0xe2,
-	0x12, 0x92, 0x52, 0xd2, 0x32, 0xb2, 0x72, 0xf2,
-	0x0a, 0x8a, 0x4a, 0xca, 0x2a, 0xaa, 0x6a, 0xea,
-	0x1a, 0x9a, 0x5a, 0xda, 0x3a, 0xba, 0x7a, 0xfa,
-	0x06, 0x86, 0x46, 0xc6, 0x26, 0xa6, 0x66, 0xe6,
-	0x16, 0x96, 0x56, 0xd6, 0x36, 0xb6, 0x76, 0xf6,
-	0x0e, 0x8e, 0x4e, 0xce, 0x2e, 0xae, 0x6e, 0xee,
-	0x1e, 0x9e, 0x5e, 0xde, 0x3e, 0xbe, 0x7e, 0xfe,
-	0x01, 0x81, 0x41, 0xc1, 0x21, 0xa1, 0x61, 0xe1,
-	0x11, 0x91, 0x51, 0xd1, 0x31, 0xb1, 0x71, 0xf1,
-	0x09, 0x89, 0x49, 0xc9, 0x29, 0xa9, 0x69, 0xe9,
-	0x19, 0x99, 0x59, 0xd9, 0x39, 0xb9, 0x79, 0xf9,
-	0x05, 0x85, 0x45, 0xc5, 0x25, 0xa5, 0x65, 0xe5,
-	0x15, 0x95, 0x55, 0xd5, 0x35, 0xb5, 0x75, 0xf5,
-	0x0d, 0x8d, 0x4d, 0xcd, 0x2d, 0xad, 0x6d, 0xed,
-	0x1d, 0x9d, 0x5d, 0xdd, 0x3d, 0xbd, 0x7d, 0xfd,
-	0x03, 0x83, 0x43, 0xc3, 0x23, 0xa3, 0x63, 0xe3,
-	0x13, 0x93, 0x53, 0xd3, 0x33, 0xb3, 0x73, 0xf3,
-	0x0b, 0x8b, 0x4b, 0xcb, 0x2b, 0xab, 0x6b, 0xeb,
-	0x1b, 0x9b, 0x5b, 0xdb, 0x3b, 0xbb, 0x7b, 0xfb,
-	0x07, 0x87, 0x47, 0xc7, 0x27, 0xa7, 0x67, 0xe7,
-	0x17, 0x97, 0x57, 0xd7, 0x37, 0xb7, 0x77, 0xf7,
-	0x0f, 0x8f, 0x4f, 0xcf, 0x2f, 0xaf, 0x6f, 0xef,
-	0x1f, 0x9f, 0x5f, 0xdf, 0x3f, 0xbf, 0x7f, 0xff
-};
+	KeySym sym;
+	int type;
+} rdpUnicodeEvent;
+
+static rdpUnicodeEvent g_unicodeEvents[RDP_UNICODE_PENDING];
+static int g_unicodeEventCount = 0;
+
+/**
+ * Event lists handed to GetPointerEvents and friends. InitEventList
+ * allocates GetMaximumEventsNum() events of several hundred bytes each, so
+ * the lists are kept per device and reused for every injected event instead
+ * of being allocated and freed each time.
+ */
+typedef struct
+{
+	InternalEvent* events;
+	int numEvents;
+} rdpEventList;
+
+static rdpEventList g_pointerEvents = { NULL, 0 };
+static rdpEventList g_keyboardEvents = { NULL, 0 };
+static rdpEventList g_touchEvents = { NULL, 0 };
+
+static InternalEvent* rdpEventListGet(rdpEventList* list)
+{
+	int numEvents = GetMaximumEventsNum();
+
+	if (list->events && list->numEvents == numEvents)
+		return list->events;
+
+	if (list->events)
+		FreeEventList(list->events, list->numEvents);
+
+	list->events = InitEventList(numEvents);
+	list->numEvents = list->events ? numEvents : 0;
+
+	return list->events;
+}
+
+static void rdpEventListFree(rdpEventList* list)
+{
+	if (list->events)
+		FreeEventList(list->events, list->numEvents);
+
+	list->events = NULL;
+	list->numEvents = 0;
+}
 
 static void KbdDeviceOn(void)
 {
@@ -133,9 +174,9 @@ int rdpKeybdProc(DeviceIntPtr pDevice, int onoff)
 	{
 		case DEVICE_INIT:
 			ZeroMemory(&set, sizeof(set));
-			set.rules = strdup("evdev");
-			set.model = strdup("pc104");
-			set.layout = strdup("us");
+			set.rules = strdup(RDP_KEYMAP_RULES);
+			set.model = strdup(RDP_KEYMAP_MODEL);
+			set.layout = strdup(RDP_KEYMAP_LAYOUT);
 			set.variant = NULL;
 			set.options = NULL;
 			InitKeyboardDeviceStruct(pDevice, &set, rdpBell,
@@ -161,6 +202,7 @@ int rdpKeybdProc(DeviceIntPtr pDevice, int onoff)
 				KbdDeviceOff();
 			}
 
+			rdpEventListFree(&g_keyboardEvents);
 			break;
 	}
 
@@ -248,6 +290,7 @@ int rdpMouseProc(DeviceIntPtr pDevice, int onoff)
 				PtrDeviceOff();
 			}
 
+			rdpEventListFree(&g_pointerEvents);
 			break;
 	}
 
@@ -306,6 +349,7 @@ static int multitouchProc(DeviceIntPtr pDevice, int onoff)
 		{
 			PtrDeviceOff();
 		}
+		rdpEventListFree(&g_touchEvents);
 		break;
 	}
 
@@ -335,170 +379,13 @@ Bool rdpSpriteRealizeCursor(DeviceIntPtr pDev, ScreenPtr pScr, CursorPtr pCurs)
 
 Bool rdpSpriteUnrealizeCursor(DeviceIntPtr pDev, ScreenPtr pScr, CursorPtr pCurs)
 {
+	rdpCursorForget(pCurs);
 	return TRUE;
 }
 
-static int get_pixel_safe(char *data, int x, int y, int width, int height, int bpp)
-{
-	int start;
-	int shift;
-	int c;
-	unsigned int *src32;
-
-	if (x < 0)
-	{
-		return 0;
-	}
-
-	if (y < 0)
-	{
-		return 0;
-	}
-
-	if (x >= width)
-	{
-		return 0;
-	}
-
-	if (y >= height)
-	{
-		return 0;
-	}
-
-	if (bpp == 1)
-	{
-		width = (width + 7) / 8;
-		start = (y * width) + x / 8;
-		shift = x % 8;
-		c = (unsigned char)(data[start]);
-#if (X_BYTE_ORDER == X_LITTLE_ENDIAN)
-		return (g_reverse_byte[c] & (0x80 >> shift)) != 0;
-#else
-		return (c & (0x80 >> shift)) != 0;
-#endif
-	}
-	else if (bpp == 32)
-	{
-		src32 = (unsigned int*)data;
-		return src32[y * width + x];
-	}
-
-	return 0;
-}
-
-static int GetBit(unsigned char *line, int x)
-{
-	unsigned char mask;
-
-	if (screenInfo.bitmapBitOrder == LSBFirst)
-		mask = (1 << (x & 7));
-	else
-		mask = (0x80 >> (x & 7));
-
-	line += (x >> 3);
-
-	if (*line & mask)
-		return 1;
-
-	return 0;
-}
-
-static void set_pixel_safe(char *data, int x, int y, int width, int height, int bpp, int pixel)
-{
-	int start;
-	int shift;
-	unsigned int *dst32;
-
-	if (x < 0)
-	{
-		return;
-	}
-
-	if (y < 0)
-	{
-		return;
-	}
-
-	if (x >= width)
-	{
-		return;
-	}
-
-	if (y >= height)
-	{
-		return;
-	}
-
-	if (bpp == 1)
-	{
-		width = (width + 7) / 8;
-		start = (y * width) + x / 8;
-		shift = x % 8;
-
-		if (pixel & 1)
-		{
-			data[start] = data[start] | (0x80 >> shift);
-		}
-		else
-		{
-			data[start] = data[start] & ~(0x80 >> shift);
-		}
-	}
-	else if (bpp == 24)
-	{
-		*(data + (3 * (y * width + x)) + 0) = pixel >> 0;
-		*(data + (3 * (y * width + x)) + 1) = pixel >> 8;
-		*(data + (3 * (y * width + x)) + 2) = pixel >> 16;
-	}
-	else if (bpp == 32)
-	{
-		dst32 = (unsigned int*)data;
-		dst32[y * width + x] = pixel;
-	}
-}
-
-static inline void set_rdp_pointer_andmask_bit(char *data, int x, int y, int width, int height, Bool on)
-{
-	/**
-	 * MS-RDPBCGR 2.2.9.1.1.4.4:
-	 * andMaskData (variable): A variable-length array of bytes.
-	 * Contains the 1-bpp, bottom-up AND mask scan-line data.
-	 * The AND mask is padded to a 2-byte boundary for each encoded scan-line.
-	 */
-	int stride, offset;
-	char mvalue;
-
-	if (width < 0 || x < 0 || x >= width) {
-		return;
-	}
-
-	if (height < 0 || y < 0 || y >= height) {
-		return;
-	}
-
-	stride = ((width + 15) >> 4) * 2;
-	offset = stride * (height-1-y) + (x >> 3);
-	mvalue = 0x80 >> (x & 7);
-
-	if (on) {
-		data[offset] |= mvalue;
-	} else {
-		data[offset] &= ~mvalue;
-	}
-}
-
 void rdpSpriteSetCursor(DeviceIntPtr pDev, ScreenPtr pScr, CursorPtr pCurs, int x, int y)
 {
-	/**
-	 * The maximum allowed RDP pointer shape width and height is 96 pixels
-	 * if the client indicated support for large pointers (LARGE_POINTER_FLAG),
-	 * otherwise the maximum width and height is 32.
-	 */
-
-	char cur_data[96 * 96 * 4];
-	char cur_mask[96 * 96 / 8];
-	int i, j, w, h, cw, ch;
-	int bpp = 32;
+	rdpCursorShape* shape;
 	ogon_msg_set_pointer msg;
 
 	g_rdpScreen.pCurs = pCurs;
@@ -506,102 +393,60 @@ void rdpSpriteSetCursor(DeviceIntPtr pDev, ScreenPtr pScr, CursorPtr pCurs, int
 	if (!g_active)
 		return;
 
-	if (pCurs && pCurs->bits)
-	{
-		w = pCurs->bits->width;
-		h = pCurs->bits->height;
-	}
-	else
-	{
-		w = 0;
-		h = 0;
-	}
-
-	if (w < 1 || h < 1)
+	if (!pCurs || !pCurs->bits || pCurs->bits->width < 1 || pCurs->bits->height < 1)
 	{
 		/* cursor must be hidden: send a rdp null system pointer */
 		ogon_msg_set_system_pointer spmsg;
 		spmsg.ptrType = SYSPTR_NULL;
 		spmsg.clientId = 0;
 		rdp_send_message(OGON_SERVER_SET_SYSTEM_POINTER, (ogon_message *) &spmsg);
+		g_pointerSerial = 0;
 		return;
 	}
 
-	cw = MIN(w, 96);
-	ch = MIN(h, 96);
-
-	msg.xPos = pCurs->bits->xhot;
-	msg.yPos = pCurs->bits->yhot;
-	msg.clientId = 0;
-
-	memset(cur_data, 0x00, sizeof(cur_data));
-	memset(cur_mask, 0xFF, sizeof(cur_mask));
-
-	if (pCurs->bits->argb)
-	{
-		int paddedRowBytes;
-		unsigned int p;
-		char* data;
+	if (!(shape = rdpCursorLookup(pCurs)))
+		return;
 
-		data = (char*)(pCurs->bits->argb);
-		paddedRowBytes = PixmapBytePad(w, bpp);
+	/* the client already shows this shape */
+	if (shape->serial == g_pointerSerial)
+		return;
 
-		for (j = 0; j < ch; j++)
-		{
-			for (i = 0; i < cw; i++)
-			{
-				p = get_pixel_safe(data, i, j, paddedRowBytes / 4, h, bpp);
-				if (p>>24) {
-					set_rdp_pointer_andmask_bit(cur_mask, i, j, cw, ch, FALSE);
-					set_pixel_safe(cur_data, i, ch - 1 - j, cw, ch, bpp, p);
-				}
-			}
-		}
-	}
-	else
-	{
-		unsigned char *srcLine = pCurs->bits->source;
-		unsigned char *mskLine = pCurs->bits->mask;
-		int stride = BitmapBytePad(w);
-		CARD32 fg, bg;
-		if (!pCurs->bits->source)
-		{
-			ErrorF(("cursor bits are zero\n"));
-			return;
-		}
+	msg.xPos = shape->xhot;
+	msg.yPos = shape->yhot;
+	msg.clientId = 0;
+	msg.xorBpp = 32;
+	msg.width = shape->width;
+	msg.height = shape->height;
+	msg.xorMaskData = shape->xorMask;
+	msg.lengthXorMask = 4 * shape->width * shape->height;
+	msg.andMaskData = shape->andMask;
+	msg.lengthAndMask = ((shape->width + 15) >> 4) * 2 * shape->height;
+
+	if (rdp_send_message(OGON_SERVER_SET_POINTER, (ogon_message *) &msg) == 0)
+		g_pointerSerial = shape->serial;
+}
 
-		fg = GetColor(PIXEL_FORMAT_ARGB32, pCurs->foreRed, pCurs->foreGreen, pCurs->foreBlue, 0xff);
-		bg = GetColor(PIXEL_FORMAT_ARGB32, pCurs->backRed, pCurs->backGreen, pCurs->backBlue, 0xff);
-		for (i = 0; i < h; i++) {
-			for (j = 0; j < w; j++) {
-				if (GetBit(mskLine, j))
-				{
-					set_rdp_pointer_andmask_bit(cur_mask, j, i, cw, ch, FALSE);
-
-					if (GetBit(srcLine, j))
-						set_pixel_safe(cur_data, j, ch - 1 - i, cw, ch, bpp, fg);
-					else
-						set_pixel_safe(cur_data, j, ch - 1 - i, cw, ch, bpp, bg);
-				}
-				else
-				{
-					set_pixel_safe(cur_data, j, ch - 1 - i, cw, ch, bpp, GetColor(PIXEL_FORMAT_ARGB32, 0,0,0,0));
-				}
-			}
-			srcLine += stride;
-			mskLine += stride;
-		}
-	}
+/* send the current cursor to a newly connected client */
+void rdpSpriteResendCursor(void)
+{
+	g_pointerSerial = 0;
+	rdpSpriteSetCursor(NULL, NULL, g_rdpScreen.pCurs, 0, 0);
 
-	msg.xorBpp = bpp;
-	msg.width = cw;
-	msg.height = ch;
-	msg.xorMaskData = (BYTE*) cur_data;
-	msg.lengthXorMask = ((bpp + 7) >> 3) * cw * ch;
-	msg.andMaskData = (BYTE*) cur_mask;
-	msg.lengthAndMask = ((cw + 15) >> 4) * 2 * ch;
+	/* resume animated cursors paused by rdpSpriteBlockHandler */
+	if (g_pScreen)
+		AnimCurSetPaused(g_pScreen, FALSE);
+}
 
-	rdp_send_message(OGON_SERVER_SET_POINTER, (ogon_message *) &msg);
+/**
+ * Animated cursors (render/animcur.c) switch frames from the screen block
+ * handler, which wakes the server for every frame. Without a client nobody
+ * sees them, so they are paused while detached. Animcur resets the pause
+ * with every server generation, hence it is set again on each call.
+ */
+void rdpSpriteBlockHandler(void)
+{
+	if (g_pScreen)
+		AnimCurSetPaused(g_pScreen, !g_active);
 }
 
 void rdpSpriteMoveCursor(DeviceIntPtr pDev, ScreenPtr pScr, int x, int y)
@@ -628,10 +473,12 @@ static void rdpEnqueueMotion(DeviceIntPtr device, int x, int y, int extraFlags)
 	ValuatorMask mask;
 	InternalEvent* rdp_events;
 
+	if (!(rdp_events = rdpEventListGet(&g_pointerEvents)))
+		return;
+
 	dx = (double) x;
 	dy = (double) y;
-	nevents = GetMaximumEventsNum();
-	rdp_events = InitEventList(nevents);
+	nevents = g_pointerEvents.numEvents;
 
 #if (XORG_VERSION_CURRENT > XORG_VERSION(1,14,0))
 	miPointerSetPosition(device, Absolute, &dx, &dy, &nevents, rdp_events);
@@ -645,9 +492,35 @@ static void rdpEnqueueMotion(DeviceIntPtr device, int x, int y, int extraFlags)
 			POINTER_ABSOLUTE | POINTER_SCREEN | extraFlags, &mask);
 
 	for (i = 0; i < nevents; i++)
+	{
 		mieqProcessDeviceEvent(device, &rdp_events[i], 0);
+	}
+}
 
-	FreeEventList(rdp_events, GetMaximumEventsNum());
+/**
+ * Send only the XI2 raw event of a motion, built like GetPointerEvents
+ * does but without positioning the sprite or touching the device's last
+ * valuators. The pointer axes have no limits and no transformation, the
+ * raw and the processed values are the screen position.
+ */
+static void rdpEnqueueRawMotion(DeviceIntPtr device, int x, int y)
+{
+	RawDeviceEvent raw;
+
+	memset(&raw, 0, sizeof(raw));
+	raw.header = ET_Internal;
+	raw.type = ET_RawMotion;
+	raw.length = sizeof(RawDeviceEvent);
+	raw.time = GetTimeInMillis();
+	raw.deviceid = device->id;
+	raw.sourceid = device->id;
+
+	SetBit(raw.valuators.mask, 0);
+	SetBit(raw.valuators.mask, 1);
+	raw.valuators.data[0] = raw.valuators.data_raw[0] = x;
+	raw.valuators.data[1] = raw.valuators.data_raw[1] = y;
+
+	mieqProcessDeviceEvent(device, (InternalEvent*) &raw, 0);
 }
 
 static void rdpEnqueueTouchEvent(int eventType, int touchId, int x, int y)
@@ -659,10 +532,14 @@ static void rdpEnqueueTouchEvent(int eventType, int touchId, int x, int y)
 	ValuatorMask mask;
 	InternalEvent* rdp_events;
 
+	KbdFlushUnicodeEvents();
+	PtrFlushMotionEvents();
+
+	if (!(rdp_events = rdpEventListGet(&g_touchEvents)))
+		return;
+
 	dx = (double) x;
 	dy = (double) y;
-	nevents = GetMaximumEventsNum();
-	rdp_events = InitEventList(nevents);
 
 	valuators[0] = dx;
 	valuators[1] = dy;
@@ -672,8 +549,6 @@ static void rdpEnqueueTouchEvent(int eventType, int touchId, int x, int y)
 
 	for (i = 0; i < nevents; i++)
 		mieqProcessDeviceEvent(g_multitouch, &rdp_events[i], 0);
-
-	FreeEventList(rdp_events, GetMaximumEventsNum());
 }
 
 
@@ -685,8 +560,11 @@ static void rdpEnqueueButton(DeviceIntPtr device, int type, int buttons)
 	InternalEvent* rdp_events;
 	int valuators[MAX_VALUATORS] = {0};
 
-	nevents = GetMaximumEventsNum();
-	rdp_events = InitEventList(nevents);
+	KbdFlushUnicodeEvents();
+	PtrFlushMotionEvents();
+
+	if (!(rdp_events = rdpEventListGet(&g_pointerEvents)))
+		return;
 
 	valuator_mask_set_range(&mask, 0, 0, valuators);
 
@@ -695,8 +573,6 @@ static void rdpEnqueueButton(DeviceIntPtr device, int type, int buttons)
 
 	for (i = 0; i < nevents; i++)
 		mieqProcessDeviceEvent(device, &rdp_events[i], 0);
-
-	FreeEventList(rdp_events, GetMaximumEventsNum());
 }
 
 static void rdpEnqueueKey(int type, int scancode)
@@ -709,8 +585,11 @@ static void rdpEnqueueKey(int type, int scancode)
 	Bool slaveAutoRepeat;
 #endif
 
-	nevents = GetMaximumEventsNum();
-	rdp_events = InitEventList(nevents);
+	KbdFlushUnicodeEvents();
+	PtrFlushMotionEvents();
+
+	if (!(rdp_events = rdpEventListGet(&g_keyboardEvents)))
+		return;
 
 	if (g_nokpcursors)
 	{
@@ -778,8 +657,6 @@ static void rdpEnqueueKey(int type, int scancode)
 	g_keyboard->master->kbdfeed->ctrl.autoRepeat = masterAutoRepeat;
 	g_keyboard->kbdfeed->ctrl.autoRepeat = slaveAutoRepeat;
 #endif
-
-	FreeEventList(rdp_events, GetMaximumEventsNum());
 }
 
 void PtrAddMotionEvent(int x, int y)
@@ -787,10 +664,47 @@ void PtrAddMotionEvent(int x, int y)
 	static int sx = 0;
 	static int sy = 0;
 
-	if (sx != x || sy != y)
-		rdpEnqueueMotion(g_pointer, x, y, 0);
+	if (sx == x && sy == y)
+		return;
+
 	sx = x;
 	sy = y;
+
+	/* unicode events received before this motion must be injected first */
+	KbdFlushUnicodeEvents();
+
+	if (!g_motionCoalesce)
+	{
+		rdpEnqueueMotion(g_pointer, x, y, 0);
+		return;
+	}
+
+	if (g_motionPending)
+	{
+		rdpStatsAdd(RDP_STATS_MOTION_COALESCED, 1);
+
+		/* XI2 raw clients (drawing programs) still get every sample */
+		if (g_rawMotionHistory)
+			rdpEnqueueRawMotion(g_pointer, g_motionX, g_motionY);
+	}
+
+	g_motionPending = TRUE;
+	g_motionX = x;
+	g_motionY = y;
+}
+
+/**
+ * Inject the pending motion. Called once all messages of a wakeup have been
+ * processed and before any button, key or touch event so these still
+ * happen at the right position.
+ */
+void PtrFlushMotionEvents(void)
+{
+	if (!g_motionPending)
+		return;
+
+	g_motionPending = FALSE;
+	rdpEnqueueMotion(g_pointer, g_motionX, g_motionY, 0);
 }
 
 void PtrAddButtonEvent(int buttonMask)
@@ -849,11 +763,7 @@ void KbdAddVirtualKeyCodeEvent(DWORD flags, DWORD vkcode)
 
 void KbdAddUnicodeEvent(DWORD flags, DWORD code)
 {
-	int type, i, keycode, mapWidth;
-	DeviceIntPtr master = g_keyboard->key->xkbInfo->device->master;
-	KeySym sym = NoSymbol;
-	KeySym newSyms[XkbMaxSymsPerKey];
-	KeySymsRec newSymsRec;
+	KeySym sym;
 
 	if (code > 0x10ffff)
 		return;
@@ -866,61 +776,45 @@ void KbdAddUnicodeEvent(DWORD flags, DWORD code)
 	else
 		sym = (KeySym)(code | 0x01000000);
 
-	if (sym == NoSymbol)
-		return;
+	/* a motion received before this event must be injected first */
+	PtrFlushMotionEvents();
 
-#if 0
-	KeySym *sym = master->key->xkbInfo->desc->map->syms;
-	for (i = 0; i<master->key->xkbInfo->desc->map->num_syms; i++, sym++)
-	{
-		fprintf(stderr, "DEBUG XXXX %04X\n", *sym);
-	}
-#endif
-
-#if 0
-	{
-		KeySymsPtr coremap;
-		KeySym* psym;
-		int j;
-
-		coremap = XkbGetCoreMap(master);
-		if (!coremap)
-			return;
-
-		psym = coremap->map;
+	if (g_unicodeEventCount == RDP_UNICODE_PENDING)
+		KbdFlushUnicodeEvents();
 
-		for (i = coremap->minKeyCode; i <= coremap->maxKeyCode; i++)
-		{
-			fprintf(stderr, "keycode %3d:", i);
-			for (j=0; j < coremap->mapWidth; j++, psym++)
-			{
-				fprintf(stderr, " 0x%04x", *psym);
-			}
-			fprintf(stderr, "\n", *psym);
-		}
-
-		free(coremap->map);
-		free(coremap);
-	}
-#endif
+	g_unicodeEvents[g_unicodeEventCount].sym = sym;
+	g_unicodeEvents[g_unicodeEventCount].type = (flags & KBD_FLAGS_DOWN) ? KeyPress : KeyRelease;
+	g_unicodeEventCount++;
+}
 
-	for (i = 0; i < XkbMaxSymsPerKey; i++) {
-		newSyms[i] = sym;
-	}
+/**
+ * Map the keysyms of the pending unicode events and inject them. Called once
+ * all messages of a wakeup have been processed and before any other input
+ * event to keep the order.
+ */
+void KbdFlushUnicodeEvents(void)
+{
+	KeySym syms[RDP_UNICODE_PENDING];
+	KeyCode keycodes[RDP_UNICODE_PENDING];
+	int i, count, done, mapped;
 
-	keycode = 255;	/* FIXME: don't assume 255 is unused ! */
-	mapWidth = 4;	/* FIXME: use real mapWidth ! */
+	if (!g_unicodeEventCount)
+		return;
 
-	newSymsRec.mapWidth = mapWidth;
-	newSymsRec.minKeyCode = keycode;
-	newSymsRec.maxKeyCode = keycode;
-	newSymsRec.map = newSyms;
+	count = g_unicodeEventCount;
+	g_unicodeEventCount = 0;
 
-	XkbApplyMappingChange(master, &newSymsRec, keycode, 1, NULL, serverClient);
+	for (i = 0; i < count; i++)
+		syms[i] = g_unicodeEvents[i].sym;
 
-	type = (flags & KBD_FLAGS_DOWN) ? KeyPress : KeyRelease;
+	for (done = 0; done < count; done += mapped)
+	{
+		if (!(mapped = rdpKeymapMapUnicode(syms + done, keycodes + done, count - done)))
+			break;
 
-	rdpEnqueueKey(type, keycode);
+		for (i = done; i < done + mapped; i++)
+			rdpEnqueueKey(g_unicodeEvents[i].type, keycodes[i]);
+	}
 }
 
 static void kbdSyncState(int xkb_flags, int rdp_flags, int keycode)
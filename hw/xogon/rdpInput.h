@@ -44,14 +44,18 @@ void rdpPointerWarpCursor(DeviceIntPtr pDev, ScreenPtr pScr, int x, int y);
 Bool rdpSpriteRealizeCursor(DeviceIntPtr pDev, ScreenPtr pScr, CursorPtr pCurs);
 Bool rdpSpriteUnrealizeCursor(DeviceIntPtr pDev, ScreenPtr pScr, CursorPtr pCurs);
 void rdpSpriteSetCursor(DeviceIntPtr pDev, ScreenPtr pScr, CursorPtr pCurs, int x, int y);
+void rdpSpriteResendCursor(void);
+void rdpSpriteBlockHandler(void);
 void rdpSpriteMoveCursor(DeviceIntPtr pDev, ScreenPtr pScr, int x, int y);
 Bool rdpSpriteDeviceCursorInitialize(DeviceIntPtr pDev, ScreenPtr pScr);
 void rdpSpriteDeviceCursorCleanup(DeviceIntPtr pDev, ScreenPtr pScr);
 void PtrAddMotionEvent(int x, int y);
 void PtrAddButtonEvent(int buttonMask);
+void PtrFlushMotionEvents(void);
 void KbdAddScancodeEvent(DWORD flags, DWORD scancode, DWORD keyboardType);
 void KbdAddVirtualKeyCodeEvent(DWORD flags, DWORD vkcode);
 void KbdAddUnicodeEvent(DWORD flags, DWORD code);
+void KbdFlushUnicodeEvents(void);
 void KbdAddSyncEvent(DWORD flags);
 void KbdResetKeyStatesUp(void);
 void KbdSessionDisconnect(void);
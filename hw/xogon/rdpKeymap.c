@@ -0,0 +1,366 @@
+/**
+ * ogon Remote Desktop Services
+ * X11 backend
+ *
+ * Copyright (C) 2013-2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * Keyboard layout switching
+ *
+ * The keymap for the layout of a connecting client is compiled through the
+ * server's own XKB code and applied to the keyboard devices directly,
+ * instead of running setxkbmap as an X client. Compiled keymaps are kept in
+ * memory for the layouts seen so far and in the XKB output directory across
+ * server instances, so a reconnect does not need to run xkbcomp at all.
+ *
+ * Unicode input is typed on keycodes the keymap leaves empty. The longest
+ * run of empty keycodes is used as a pool, a keysym keeps its keycode until
+ * the pool runs out and the least recently used one is remapped. All new
+ * keysyms of a batch of events go into a single mapping change, so clients
+ * reload their keymap once per batch instead of once per character.
+ */
+
+#include "rdp.h"
+#include "rdpKeymap.h"
+
+#include <xkbsrv.h>
+
+#define RDP_KEYMAP_CACHE_SIZE	8
+#define RDP_KEYMAP_MAX_LAYOUT	32
+
+#define RDP_UNICODE_KEYCODES	16
+#define RDP_UNICODE_MAP_WIDTH	4
+
+typedef struct _rdpKeymapEntry
+{
+	char layout[RDP_KEYMAP_MAX_LAYOUT];
+	XkbDescPtr xkb;
+} rdpKeymapEntry;
+
+typedef struct _rdpUnicodeKey
+{
+	KeyCode keycode;
+	KeySym sym;
+	UINT32 lastUsed;
+} rdpUnicodeKey;
+
+extern DeviceIntPtr g_keyboard;
+
+/* most recently used first */
+static rdpKeymapEntry g_keymaps[RDP_KEYMAP_CACHE_SIZE];
+static int g_keymapCount = 0;
+
+/* ascending keycodes, all of them in one run */
+static rdpUnicodeKey g_unicodeKeys[RDP_UNICODE_KEYCODES];
+static int g_unicodeKeyCount = 0;
+static UINT32 g_unicodeClock = 0;
+
+static void rdpKeymapInitRMLVO(XkbRMLVOSet* rmlvo, const char* layout)
+{
+	rmlvo->rules = (char*) RDP_KEYMAP_RULES;
+	rmlvo->model = (char*) RDP_KEYMAP_MODEL;
+	rmlvo->layout = (char*) layout;
+	rmlvo->variant = NULL;
+	rmlvo->options = NULL;
+}
+
+static XkbDescPtr rdpKeymapLookup(const char* layout)
+{
+	XkbRMLVOSet rmlvo;
+	rdpKeymapEntry entry;
+	char cacheName[64];
+	int i;
+
+	for (i = 0; i < g_keymapCount; i++)
+	{
+		if (strcmp(g_keymaps[i].layout, layout) == 0)
+			break;
+	}
+
+	if (i < g_keymapCount)
+	{
+		entry = g_keymaps[i];
+	}
+	else
+	{
+		/* the uid keeps servers of different users from sharing the file */
+		snprintf(cacheName, sizeof(cacheName), "ogon-%u-%s-%s-%s", (unsigned) geteuid(),
+				RDP_KEYMAP_RULES, RDP_KEYMAP_MODEL, layout);
+		rdpKeymapInitRMLVO(&rmlvo, layout);
+
+		entry.xkb = XkbCompileKeymapCached(g_keyboard, &rmlvo, cacheName);
+
+		if (!entry.xkb)
+			return NULL;
+
+		strcpy(entry.layout, layout);
+
+		if (g_keymapCount == RDP_KEYMAP_CACHE_SIZE)
+			XkbFreeKeyboard(g_keymaps[--g_keymapCount].xkb, XkbAllComponentsMask, TRUE);
+
+		i = g_keymapCount++;
+	}
+
+	memmove(&g_keymaps[1], &g_keymaps[0], i * sizeof(rdpKeymapEntry));
+	g_keymaps[0] = entry;
+
+	return entry.xkb;
+}
+
+/**
+ * Switch the keyboard to the given XKB layout name. Returns FALSE if the
+ * keymap could not be compiled, the keyboard is left unchanged in that case.
+ * The keymap is applied even if the layout did not change, like setxkbmap
+ * did on every connect, so changes made inside the session are reset.
+ */
+Bool rdpKeymapSetLayout(const char* layout)
+{
+	XkbRMLVOSet rmlvo;
+	XkbDescPtr xkb;
+	DeviceIntPtr master;
+
+	if (!g_keyboard || !layout || strlen(layout) >= RDP_KEYMAP_MAX_LAYOUT)
+		return FALSE;
+
+	if (!(xkb = rdpKeymapLookup(layout)))
+	{
+		ErrorF("rdpKeymapSetLayout: unable to compile keymap for layout %s\n", layout);
+		return FALSE;
+	}
+
+	if (!XkbDeviceApplyKeymap(g_keyboard, xkb))
+	{
+		ErrorF("rdpKeymapSetLayout: unable to apply keymap for layout %s\n", layout);
+		return FALSE;
+	}
+
+	master = GetMaster(g_keyboard, MASTER_KEYBOARD);
+
+	if (master)
+		XkbDeviceApplyKeymap(master, xkb);
+
+	/* keep _XKB_RULES_NAMES in sync like setxkbmap does */
+	rdpKeymapInitRMLVO(&rmlvo, layout);
+	XkbSetRulesUsed(&rmlvo);
+
+	return TRUE;
+}
+
+/* whether the keymap has exactly the mapping we gave keycode to sym */
+static Bool rdpUnicodeKeyValid(XkbDescPtr xkb, KeyCode keycode, KeySym sym)
+{
+	KeySym* syms;
+	int i, n;
+
+	n = XkbKeyNumSyms(xkb, keycode);
+
+	if (sym == NoSymbol)
+		return n == 0;
+
+	syms = XkbKeySymsPtr(xkb, keycode);
+
+	for (i = 0; i < n; i++)
+	{
+		if (syms[i] != sym)
+			return FALSE;
+	}
+
+	return n > 0;
+}
+
+static rdpUnicodeKey* rdpUnicodeFindKey(KeyCode keycode)
+{
+	int i;
+
+	for (i = 0; i < g_unicodeKeyCount; i++)
+	{
+		if (g_unicodeKeys[i].keycode == keycode)
+			return &g_unicodeKeys[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * Pick the longest run of keycodes which are empty or still carry one of
+ * our mappings. Keys of the previous pool keep their keysym.
+ */
+static void rdpUnicodeScan(XkbDescPtr xkb)
+{
+	rdpUnicodeKey keys[RDP_UNICODE_KEYCODES];
+	rdpUnicodeKey* old;
+	int keycode, run, first, best, bestFirst;
+	int i;
+
+	run = best = 0;
+	first = bestFirst = xkb->min_key_code;
+
+	for (keycode = xkb->min_key_code; keycode <= xkb->max_key_code + 1; keycode++)
+	{
+		if (keycode <= xkb->max_key_code && (XkbKeyNumSyms(xkb, keycode) == 0 ||
+				((old = rdpUnicodeFindKey(keycode)) && rdpUnicodeKeyValid(xkb, keycode, old->sym))))
+		{
+			if (run++ == 0)
+				first = keycode;
+
+			continue;
+		}
+
+		if (run > best)
+		{
+			best = run;
+			bestFirst = first;
+		}
+
+		run = 0;
+	}
+
+	if (best > RDP_UNICODE_KEYCODES)
+		best = RDP_UNICODE_KEYCODES;
+
+	for (i = 0; i < best; i++)
+	{
+		keys[i].keycode = bestFirst + i;
+		keys[i].sym = NoSymbol;
+		keys[i].lastUsed = 0;
+
+		if ((old = rdpUnicodeFindKey(keys[i].keycode)) && XkbKeyNumSyms(xkb, keys[i].keycode) > 0)
+			keys[i] = *old;
+	}
+
+	memcpy(g_unicodeKeys, keys, best * sizeof(rdpUnicodeKey));
+	g_unicodeKeyCount = best;
+
+	if (best == 0)
+		ErrorF("rdpUnicodeScan: no free keycodes for unicode input\n");
+}
+
+static Bool rdpUnicodeKeyDown(DeviceIntPtr master, KeyCode keycode)
+{
+	return BitIsOn(g_keyboard->key->down, keycode) ||
+			(master && BitIsOn(master->key->down, keycode));
+}
+
+/**
+ * Find or assign keycodes for syms. Keysyms which are not mapped yet are
+ * mapped with one mapping change. Returns how many leading syms got a
+ * keycode, this is less than count if the batch has more distinct keysyms
+ * than the pool has keycodes.
+ */
+int rdpKeymapMapUnicode(const KeySym* syms, KeyCode* keycodes, int count)
+{
+	KeySym map[RDP_UNICODE_KEYCODES * RDP_UNICODE_MAP_WIDTH];
+	KeySymsRec mapRec;
+	DeviceIntPtr master;
+	XkbDescPtr xkb;
+	rdpUnicodeKey* key;
+	int i, j, n;
+	int lo = RDP_UNICODE_KEYCODES;
+	int hi = -1;
+
+	if (!g_keyboard || count < 1)
+		return 0;
+
+	master = GetMaster(g_keyboard, MASTER_KEYBOARD);
+	xkb = (master ? master : g_keyboard)->key->xkbInfo->desc;
+
+	/* the keymap may have been replaced under us (layout change, xmodmap) */
+	for (i = 0; i < g_unicodeKeyCount; i++)
+	{
+		if (!rdpUnicodeKeyValid(xkb, g_unicodeKeys[i].keycode, g_unicodeKeys[i].sym))
+			break;
+	}
+
+	if (g_unicodeKeyCount == 0 || i < g_unicodeKeyCount)
+		rdpUnicodeScan(xkb);
+
+	g_unicodeClock++;
+
+	for (n = 0; n < count; n++)
+	{
+		key = NULL;
+
+		for (i = 0; i < g_unicodeKeyCount; i++)
+		{
+			if (g_unicodeKeys[i].sym == syms[n])
+			{
+				key = &g_unicodeKeys[i];
+				break;
+			}
+		}
+
+		if (!key)
+		{
+			/* least recently used, neither pressed nor needed by this batch */
+			for (i = 0; i < g_unicodeKeyCount; i++)
+			{
+				if (g_unicodeKeys[i].lastUsed == g_unicodeClock ||
+						rdpUnicodeKeyDown(master, g_unicodeKeys[i].keycode))
+					continue;
+
+				if (!key || g_unicodeKeys[i].lastUsed < key->lastUsed)
+					key = &g_unicodeKeys[i];
+			}
+
+			if (!key)
+				break;
+
+			key->sym = syms[n];
+			i = key - g_unicodeKeys;
+			lo = min(lo, i);
+			hi = max(hi, i);
+		}
+
+		key->lastUsed = g_unicodeClock;
+		keycodes[n] = key->keycode;
+	}
+
+	if (hi >= lo)
+	{
+		for (i = lo; i <= hi; i++)
+		{
+			for (j = 0; j < RDP_UNICODE_MAP_WIDTH; j++)
+				map[(i - lo) * RDP_UNICODE_MAP_WIDTH + j] = g_unicodeKeys[i].sym;
+		}
+
+		mapRec.map = map;
+		mapRec.mapWidth = RDP_UNICODE_MAP_WIDTH;
+		mapRec.minKeyCode = g_unicodeKeys[lo].keycode;
+		mapRec.maxKeyCode = g_unicodeKeys[hi].keycode;
+
+		/* the slave too, or switching slaves copies the old map back */
+		XkbApplyMappingChange(g_keyboard, &mapRec, mapRec.minKeyCode,
+				hi - lo + 1, NULL, serverClient);
+
+		if (master)
+			XkbApplyMappingChange(master, &mapRec, mapRec.minKeyCode,
+					hi - lo + 1, NULL, serverClient);
+	}
+
+	return n;
+}
+
+void rdpKeymapUninit(void)
+{
+	while (g_keymapCount > 0)
+		XkbFreeKeyboard(g_keymaps[--g_keymapCount].xkb, XkbAllComponentsMask, TRUE);
+}
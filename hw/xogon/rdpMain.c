@@ -36,6 +36,16 @@
 #include "rdpRandr.h"
 #include "rdpScreen.h"
 #include "rdpUpdate.h"
+#include "rdpCopy.h"
+#include "rdpTiles.h"
+#include "rdpFrame.h"
+#include "rdpMove.h"
+#include "rdpStats.h"
+#include "rdpTrace.h"
+#include "rdpCursor.h"
+#include "rdpHelper.h"
+#include "rdpKeymap.h"
+#include "rdpStandby.h"
 #include <version-config.h>
 
 #include "glx_extinit.h"
@@ -76,6 +86,13 @@ static int g_initOutputCalled = 0;
 int g_width_max = -1;
 int g_height_max = -1;
 int g_nokpcursors = 0;
+int g_motionCoalesce = 1;
+int g_rawMotionHistory = 0;
+int g_damageThreads = 1;
+int g_damageMergeWaste = 10;
+int g_fps = 0;
+int g_damageBuffers = 1;
+int g_standbyFd = -1;
 
 
 /* Common pixmap formats */
@@ -167,22 +184,10 @@ static int set_bpp(int bpp)
 	return rv;
 }
 
-static void rdpWakeupHandler(void *blockData, int result, void *pReadmask)
-{
-	/*
-	 * If select returns -1 the sets are undefined.
-	 * don't process the sets in that case.
-	 */
-	if (result < 0)
-	{
-		return;
-	}
-	rdp_check(blockData, result, pReadmask);
-}
-
 static void rdpBlockHandler(void *blockData, OSTimePtr pTimeout, void *pReadmask)
 {
 	rdp_handle_damage_region(0);
+	rdpSpriteBlockHandler();
 }
 
 static Bool rdpSaveScreen(ScreenPtr pScreen, int on)
@@ -369,11 +374,13 @@ static Bool rdpScreenInit(ScreenPtr pScreen, int argc, char** argv)
 			DEBUG_OUT("rdpScreenInit: fbCreateDefColormap failed\n");
 		}
 	}
-	init_messages_list();
 
 	if (ret)
 	{
-		ret = rdp_init();
+		if (rdpStandbyWaiting())
+			rdpStandbyInit();
+		else
+			ret = rdp_init();
 
 		if (!ret)
 		{
@@ -383,7 +390,15 @@ static Bool rdpScreenInit(ScreenPtr pScreen, int argc, char** argv)
 
 	if (ret)
 	{
-		RegisterBlockAndWakeupHandlers(rdpBlockHandler, rdpWakeupHandler, NULL);
+		RegisterBlockAndWakeupHandlers(rdpBlockHandler, (ServerWakeupHandlerProcPtr) NoopDDA, NULL);
+	}
+
+	rdpFrameInit(g_fps);
+	rdpStatsInit(g_statsInterval);
+
+	if (rdpCopyInit(g_damageThreads) < 0)
+	{
+		ErrorF("rdpScreenInit: failed to start all damage copy threads\n");
 	}
 
 
@@ -398,6 +413,19 @@ static Bool rdpScreenInit(ScreenPtr pScreen, int argc, char** argv)
 		FatalError("rdpScreenInit: DamageCreate failed\n");
 	}
 
+	/* the moves only end up in the statistics, don't wrap GCs for nothing */
+	if (g_rdpScreen.detectMoves && g_statsInterval <= 0)
+	{
+		ErrorF("rdpScreenInit: -detectmoves needs -statsinterval, ignored\n");
+		g_rdpScreen.detectMoves = FALSE;
+	}
+
+	if (g_rdpScreen.detectMoves && !rdpMoveInit(pScreen))
+	{
+		ErrorF("rdpScreenInit: rdpMoveInit failed\n");
+		g_rdpScreen.detectMoves = FALSE;
+	}
+
 	rdpRRInit(pScreen);
 
 	return ret;
@@ -468,6 +496,138 @@ int ddxProcessArgument(int argc, char** argv, int i)
 			g_dpi = dpi;
 		}
 	}
+	if (strcmp(argv[i], "-zerocopy") == 0)
+	{
+		g_rdpScreen.zeroCopy = TRUE;
+		return 1;
+	}
+	if (strcmp(argv[i], "-tilehash") == 0)
+	{
+		g_rdpScreen.tileHash = TRUE;
+		return 1;
+	}
+	if (strcmp(argv[i], "-detectmoves") == 0)
+	{
+		g_rdpScreen.detectMoves = TRUE;
+		return 1;
+	}
+	if (strcmp(argv[i], "-damagethreads") == 0)
+	{
+		if (i + 1 >= argc)
+		{
+			UseMsg();
+		}
+
+		g_damageThreads = atoi(argv[i + 1]);
+
+		if (g_damageThreads < 1)
+		{
+			UseMsg();
+		}
+
+		return 2;
+	}
+	if (strcmp(argv[i], "-damagemerge") == 0)
+	{
+		if (i + 1 >= argc)
+		{
+			UseMsg();
+		}
+
+		g_damageMergeWaste = atoi(argv[i + 1]);
+
+		if (g_damageMergeWaste < 0 || g_damageMergeWaste > 100)
+		{
+			UseMsg();
+		}
+
+		return 2;
+	}
+	if (strcmp(argv[i], "-fps") == 0)
+	{
+		if (i + 1 >= argc)
+		{
+			UseMsg();
+		}
+
+		g_fps = atoi(argv[i + 1]);
+
+		/* above 1000 the interval rounds down to 0 ms */
+		if (g_fps < 0 || g_fps > 1000)
+		{
+			UseMsg();
+		}
+
+		return 2;
+	}
+	if (strcmp(argv[i], "-statsinterval") == 0)
+	{
+		if (i + 1 >= argc)
+		{
+			UseMsg();
+		}
+
+		g_statsInterval = atoi(argv[i + 1]);
+
+		if (g_statsInterval < 0)
+		{
+			UseMsg();
+		}
+
+		return 2;
+	}
+	if (strcmp(argv[i], "-dmgbufs") == 0)
+	{
+		if (i + 1 >= argc)
+		{
+			UseMsg();
+		}
+
+		g_damageBuffers = atoi(argv[i + 1]);
+
+		if (g_damageBuffers < 1 || g_damageBuffers > 3)
+		{
+			UseMsg();
+		}
+
+		return 2;
+	}
+	if (strcmp(argv[i], "-damagetrace") == 0)
+	{
+		if (i + 1 >= argc)
+		{
+			UseMsg();
+		}
+
+		if (!rdpTraceOpen(argv[i + 1]))
+		{
+			UseMsg();
+		}
+
+		return 2;
+	}
+	if (strcmp(argv[i], "-nomotioncoalesce") == 0)
+	{
+		g_motionCoalesce = 0;
+		return 1;
+	}
+	if (strcmp(argv[i], "-rawmotionhistory") == 0)
+	{
+		g_rawMotionHistory = 1;
+		return 1;
+	}
+	if (strcmp(argv[i], "-standby") == 0)
+	{
+		if (i + 1 >= argc)
+		{
+			UseMsg();
+		}
+
+		/* no display yet, see rdpStandby.c */
+		g_standbyFd = atoi(argv[i + 1]);
+		NoListenAll = TRUE;
+		return 2;
+	}
 	if (strcmp(argv[i], "-nkc") == 0)
 	{
 		g_nokpcursors = 1;
@@ -539,6 +699,9 @@ void InitOutput(ScreenInfo* pScreenInfo, int argc, char** argv)
 		return;
 	}
 
+	/* before the framebuffer and the copy threads exist */
+	rdpHelperInit();
+
 	/* initialize screen */
 	if (AddScreen(rdpScreenInit, argc, argv) == -1)
 	{
@@ -571,7 +734,20 @@ void ddxGiveUp(enum ExitCode error)
 
 	DEBUG_OUT("ddxGiveUp:\n");
 
+	rdpCopyUninit();
+	rdpTilesUninit();
+	rdpFrameUninit();
+	rdpStatsUninit();
+	rdpTraceClose();
+	rdpCursorUninit();
+	rdpHelperStop();
+	rdpKeymapUninit();
 	rdpScreenDestroyFrameBuffer();
+
+	/* a standby server does not own the display it was started with */
+	if (rdpStandbyWaiting())
+		return;
+
 	ogon_named_pipe_clean_endpoint(atoi(display), "X11");
 
 	if (g_initOutputCalled)
@@ -608,6 +784,18 @@ void __attribute__((__noreturn__)) ddxUseMsg(void)
 	ErrorF("ogon-backend-x specific options\n");
 	ErrorF("-geometry WxH          set framebuffer width & height\n");
 	ErrorF("-depth D               set framebuffer depth\n");
+	ErrorF("-zerocopy              render directly into the ogon damage buffer\n");
+	ErrorF("-tilehash              skip damaged tiles repainted with identical content\n");
+	ErrorF("-detectmoves           count screen to screen copies in -statsinterval output\n");
+	ErrorF("-damagethreads N       number of threads used to copy damaged areas\n");
+	ErrorF("-damagemerge P         merge damaged areas wasting less than P%% (default 10)\n");
+	ErrorF("-dmgbufs N             number of damage buffers ogon may rotate (1-3)\n");
+	ErrorF("-damagetrace FILE      record the damage of every frame for rdp-damage-replay\n");
+	ErrorF("-statsinterval S       log frame statistics every S seconds\n");
+	ErrorF("-fps N                 limit frame updates to N per second (1-1000), 0 for no limit (default)\n");
+	ErrorF("-nomotioncoalesce      inject every pointer motion instead of the last one per wakeup\n");
+	ErrorF("-rawmotionhistory      send XI2 raw events for coalesced pointer motions\n");
+	ErrorF("-standby fd            initialize and wait for a display number on fd\n");
 	ErrorF("\n");
 	exit(1);
 }
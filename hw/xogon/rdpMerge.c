@@ -0,0 +1,228 @@
+/**
+ * ogon Remote Desktop Services
+ * X11 backend
+ *
+ * Copyright (C) 2013-2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * Damage rectangle merging
+ *
+ * Reduces the damage region to the number of rectangles the damage buffer
+ * can hold. The pair of boxes which adds the least area when replaced by
+ * its bounding box is merged until the count fits. If wastePercent is set,
+ * merging continues as long as the added area stays below that percentage
+ * of the merged box, which saves the encoder the per-rectangle overhead of
+ * many small nearby updates.
+ */
+
+#include "rdp.h"
+#include "rdpMerge.h"
+
+#include <string.h>
+
+/* upper bound for the quadratic greedy pass */
+#define RDP_MERGE_MAX_BOXES	256
+
+/* neighbours searched on each side in the waste pass */
+#define RDP_MERGE_WINDOW	8
+
+static BoxRec g_mergeBoxes[RDP_MERGE_MAX_BOXES];
+static INT64 g_mergeCost[RDP_MERGE_MAX_BOXES];
+static int g_mergeIdx[RDP_MERGE_MAX_BOXES];
+static int g_mergeWindow;
+
+static INT64 rdpMergeArea(const BoxRec* box)
+{
+	return (INT64) (box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+static void rdpMergeUnion(const BoxRec* a, const BoxRec* b, BoxPtr out)
+{
+	out->x1 = min(a->x1, b->x1);
+	out->y1 = min(a->y1, b->y1);
+	out->x2 = max(a->x2, b->x2);
+	out->y2 = max(a->y2, b->y2);
+}
+
+/* area which gets added when a and b are replaced by their bounding box */
+static INT64 rdpMergeCost(const BoxRec* a, const BoxRec* b, INT64* unionArea)
+{
+	BoxRec u;
+	INT64 overlap = 0;
+	int w, h;
+
+	rdpMergeUnion(a, b, &u);
+	*unionArea = rdpMergeArea(&u);
+
+	w = min(a->x2, b->x2) - max(a->x1, b->x1);
+	h = min(a->y2, b->y2) - max(a->y1, b->y1);
+
+	if (w > 0 && h > 0)
+		overlap = (INT64) w * h;
+
+	return *unionArea - (rdpMergeArea(a) + rdpMergeArea(b) - overlap);
+}
+
+static void rdpMergeFindBest(int k, int numBoxes)
+{
+	int i, first, end;
+	INT64 cost, unionArea;
+
+	g_mergeIdx[k] = -1;
+
+	first = max(0, k - g_mergeWindow);
+	end = min(numBoxes, k + g_mergeWindow + 1);
+
+	for (i = first; i < end; i++)
+	{
+		if (i == k)
+			continue;
+
+		cost = rdpMergeCost(&g_mergeBoxes[k], &g_mergeBoxes[i], &unionArea);
+
+		if (g_mergeIdx[k] < 0 || cost < g_mergeCost[k])
+		{
+			g_mergeCost[k] = cost;
+			g_mergeIdx[k] = i;
+		}
+	}
+}
+
+/**
+ * Merge boxes until there are at most maxBoxes left. The input is not
+ * modified, result points to a static array which stays valid until the
+ * next call. Returns the number of boxes in result.
+ */
+int rdpMergeBoxes(const BoxRec* boxes, int numBoxes, int maxBoxes,
+		int wastePercent, BoxPtr* result)
+{
+	int i, j, k, n, orig;
+	INT64 cost, unionArea;
+
+	if (maxBoxes < 1)
+		maxBoxes = 1;
+
+	if (numBoxes <= maxBoxes && (wastePercent <= 0 || numBoxes > RDP_MERGE_MAX_BOXES))
+	{
+		*result = (BoxPtr) boxes;
+		return numBoxes;
+	}
+
+	/**
+	 * Too many boxes for the greedy pass: pre-merge runs of neighbours in
+	 * region order (these are mostly in the same or the next band).
+	 */
+	if (numBoxes > RDP_MERGE_MAX_BOXES)
+	{
+		n = RDP_MERGE_MAX_BOXES;
+
+		for (k = 0; k < n; k++)
+		{
+			i = (int) (((INT64) k * numBoxes) / n);
+			j = (int) (((INT64) (k + 1) * numBoxes) / n);
+
+			g_mergeBoxes[k] = boxes[i];
+
+			while (++i < j)
+				rdpMergeUnion(&g_mergeBoxes[k], &boxes[i], &g_mergeBoxes[k]);
+		}
+	}
+	else
+	{
+		n = numBoxes;
+		memcpy(g_mergeBoxes, boxes, n * sizeof(BoxRec));
+	}
+
+	/**
+	 * The waste pass only merges boxes which nearly touch, and those are
+	 * close to each other in region order. Only a window of neighbours is
+	 * searched there, which keeps the usual frame linear in the box count.
+	 * Reducing to maxBoxes needs the best pair over all boxes.
+	 */
+	g_mergeWindow = (n > maxBoxes) ? n : RDP_MERGE_WINDOW;
+
+	for (k = 0; k < n; k++)
+		rdpMergeFindBest(k, n);
+
+	while (n > 1)
+	{
+		i = 0;
+
+		for (k = 1; k < n; k++)
+		{
+			if (g_mergeCost[k] < g_mergeCost[i])
+				i = k;
+		}
+
+		j = g_mergeIdx[i];
+
+		if (n <= maxBoxes)
+		{
+			cost = rdpMergeCost(&g_mergeBoxes[i], &g_mergeBoxes[j], &unionArea);
+
+			if (cost * 100 >= unionArea * wastePercent)
+				break;
+		}
+
+		/**
+		 * Merge j into i and close the gap, keeping the region order the
+		 * neighbour window relies on.
+		 */
+		rdpMergeUnion(&g_mergeBoxes[i], &g_mergeBoxes[j], &g_mergeBoxes[i]);
+
+		n--;
+		memmove(&g_mergeBoxes[j], &g_mergeBoxes[j + 1], (n - j) * sizeof(BoxRec));
+		memmove(&g_mergeCost[j], &g_mergeCost[j + 1], (n - j) * sizeof(INT64));
+		memmove(&g_mergeIdx[j], &g_mergeIdx[j + 1], (n - j) * sizeof(int));
+
+		orig = i;
+
+		if (i > j)
+			i--;
+
+		for (k = 0; k < n; k++)
+		{
+			if (k == i || g_mergeIdx[k] == j || g_mergeIdx[k] == orig)
+			{
+				rdpMergeFindBest(k, n);
+				continue;
+			}
+
+			if (g_mergeIdx[k] > j)
+				g_mergeIdx[k]--;
+
+			if (k < i - g_mergeWindow || k > i + g_mergeWindow)
+				continue;
+
+			cost = rdpMergeCost(&g_mergeBoxes[k], &g_mergeBoxes[i], &unionArea);
+
+			if (cost < g_mergeCost[k])
+			{
+				g_mergeCost[k] = cost;
+				g_mergeIdx[k] = i;
+			}
+		}
+	}
+
+	*result = g_mergeBoxes;
+	return n;
+}
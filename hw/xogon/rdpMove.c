@@ -0,0 +1,343 @@
+/**
+ * ogon Remote Desktop Services
+ * X11 backend
+ *
+ * Copyright (C) 2013-2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * Screen to screen move detection
+ *
+ * CopyWindow and CopyArea between windows on the screen pixmap are recorded
+ * as moves (destination box and offset to the source) for the current
+ * frame, so that the RDP side can reproduce scrolls and window moves with
+ * ScreenBlt orders instead of encoding the moved pixels.
+ *
+ * A move is only valid if its source was already sent to ogon, parts whose
+ * source overlaps damage still pending for the frame are left out. Moves
+ * must be applied in order and before the damage rects of the same frame.
+ *
+ * The GC wrapping follows miext/damage. The screen functions are wrapped
+ * after DamageSetup() so the damage layer still sees every operation.
+ */
+
+#include "rdp.h"
+#include "rdpMove.h"
+
+#include "gcstruct.h"
+#include "windowstr.h"
+
+#define RDP_MOVE_MAX		64
+
+typedef struct _rdpMoveGCPrivRec
+{
+	const GCFuncs* funcs;
+	const GCOps* ops;
+	GCOps wrappedOps;
+} rdpMoveGCPrivRec;
+typedef rdpMoveGCPrivRec* rdpMoveGCPrivPtr;
+
+extern rdpScreenInfoRec g_rdpScreen;
+
+static DevPrivateKeyRec g_moveGCKeyRec;
+
+static CreateGCProcPtr g_moveCreateGC = NULL;
+static CopyWindowProcPtr g_moveCopyWindow = NULL;
+
+static rdpMoveRec g_moves[RDP_MOVE_MAX];
+static int g_numMoves = 0;
+static BOOL g_movesOverflow = FALSE;
+
+static void rdpMoveValidateGC(GCPtr pGC, unsigned long changes, DrawablePtr pDrawable);
+static void rdpMoveChangeGC(GCPtr pGC, unsigned long mask);
+static void rdpMoveCopyGC(GCPtr pGCSrc, unsigned long mask, GCPtr pGCDst);
+static void rdpMoveDestroyGC(GCPtr pGC);
+static void rdpMoveChangeClip(GCPtr pGC, int type, void* pValue, int nrects);
+static void rdpMoveDestroyClip(GCPtr pGC);
+static void rdpMoveCopyClip(GCPtr pGCDst, GCPtr pGCSrc);
+static RegionPtr rdpMoveCopyArea(DrawablePtr pSrc, DrawablePtr pDst, GCPtr pGC,
+		int srcx, int srcy, int w, int h, int dstx, int dsty);
+
+static const GCFuncs g_moveGCFuncs =
+{
+	rdpMoveValidateGC, rdpMoveChangeGC, rdpMoveCopyGC, rdpMoveDestroyGC,
+	rdpMoveChangeClip, rdpMoveDestroyClip, rdpMoveCopyClip
+};
+
+static rdpMoveGCPrivPtr rdpMoveGetGCPriv(GCPtr pGC)
+{
+	return (rdpMoveGCPrivPtr) dixLookupPrivate(&pGC->devPrivates, &g_moveGCKeyRec);
+}
+
+#define RDP_MOVE_GC_FUNC_PROLOGUE(_pGC) \
+	rdpMoveGCPrivPtr priv = rdpMoveGetGCPriv(_pGC); \
+	(_pGC)->funcs = priv->funcs; \
+	if (priv->ops) (_pGC)->ops = priv->ops
+
+#define RDP_MOVE_GC_FUNC_EPILOGUE(_pGC) \
+	priv->funcs = (_pGC)->funcs; \
+	(_pGC)->funcs = &g_moveGCFuncs; \
+	if (priv->ops) { \
+		priv->ops = (_pGC)->ops; \
+		priv->wrappedOps = *(_pGC)->ops; \
+		priv->wrappedOps.CopyArea = rdpMoveCopyArea; \
+		(_pGC)->ops = &priv->wrappedOps; \
+	}
+
+static BOOL rdpMoveIsOnScreen(DrawablePtr pDrawable)
+{
+	WindowPtr pWin;
+	ScreenPtr pScreen = pDrawable->pScreen;
+
+	if (pDrawable->type != DRAWABLE_WINDOW)
+		return FALSE;
+
+	pWin = (WindowPtr) pDrawable;
+
+	if (!pWin->viewable)
+		return FALSE;
+
+	/* redirected windows are not drawn to the screen directly */
+	return pScreen->GetWindowPixmap(pWin) == pScreen->GetScreenPixmap(pScreen);
+}
+
+/**
+ * Record the move of region (destination coordinates) by dx/dy. Parts
+ * whose source is pending damage are dropped from the move.
+ */
+static void rdpMoveRecord(RegionPtr region, int dx, int dy)
+{
+	RegionPtr damage;
+	BoxPtr boxes;
+	int i, numBoxes;
+
+	if (!g_rdpScreen.x11DamageRegistered || g_movesOverflow)
+		return;
+
+	if (dx == 0 && dy == 0)
+		return;
+
+	damage = DamageRegion(g_rdpScreen.x11Damage);
+
+	if (RegionNotEmpty(damage))
+	{
+		RegionTranslate(damage, dx, dy);
+		RegionSubtract(region, region, damage);
+		RegionTranslate(damage, -dx, -dy);
+	}
+
+	numBoxes = RegionNumRects(region);
+	boxes = RegionRects(region);
+
+	if (g_numMoves + numBoxes > RDP_MOVE_MAX)
+	{
+		/* the whole frame falls back to plain damage */
+		g_movesOverflow = TRUE;
+		g_numMoves = 0;
+		return;
+	}
+
+	for (i = 0; i < numBoxes; i++)
+	{
+		g_moves[g_numMoves].dst = boxes[i];
+		g_moves[g_numMoves].dx = dx;
+		g_moves[g_numMoves].dy = dy;
+		g_numMoves++;
+	}
+}
+
+static RegionPtr rdpMoveCopyArea(DrawablePtr pSrc, DrawablePtr pDst, GCPtr pGC,
+		int srcx, int srcy, int w, int h, int dstx, int dsty)
+{
+	rdpMoveGCPrivPtr priv = rdpMoveGetGCPriv(pGC);
+	const GCFuncs* oldFuncs = pGC->funcs;
+	RegionRec moved;
+	RegionPtr ret;
+	BoxRec box;
+	int dx, dy;
+
+	if (pGC->alu == GXcopy && rdpMoveIsOnScreen(pSrc) && rdpMoveIsOnScreen(pDst) &&
+			pGC->pCompositeClip && w > 0 && h > 0)
+	{
+		box.x1 = pDst->x + dstx;
+		box.y1 = pDst->y + dsty;
+		box.x2 = box.x1 + w;
+		box.y2 = box.y1 + h;
+		dx = box.x1 - (pSrc->x + srcx);
+		dy = box.y1 - (pSrc->y + srcy);
+
+		/* only what is visible at both ends is a move, the rest is exposed */
+		RegionInit(&moved, &box, 1);
+		RegionIntersect(&moved, &moved, pGC->pCompositeClip);
+		RegionTranslate(&moved, -dx, -dy);
+		RegionIntersect(&moved, &moved, &((WindowPtr) pSrc)->clipList);
+		RegionTranslate(&moved, dx, dy);
+
+		/* check the pending damage before the copy adds its own */
+		if (RegionNotEmpty(&moved))
+			rdpMoveRecord(&moved, dx, dy);
+
+		RegionUninit(&moved);
+	}
+
+	pGC->funcs = priv->funcs;
+	pGC->ops = priv->ops;
+	ret = pGC->ops->CopyArea(pSrc, pDst, pGC, srcx, srcy, w, h, dstx, dsty);
+	priv->funcs = pGC->funcs;
+	priv->ops = pGC->ops;
+	priv->wrappedOps = *pGC->ops;
+	priv->wrappedOps.CopyArea = rdpMoveCopyArea;
+	pGC->funcs = oldFuncs;
+	pGC->ops = &priv->wrappedOps;
+
+	return ret;
+}
+
+static void rdpMoveValidateGC(GCPtr pGC, unsigned long changes, DrawablePtr pDrawable)
+{
+	RDP_MOVE_GC_FUNC_PROLOGUE(pGC);
+	pGC->funcs->ValidateGC(pGC, changes, pDrawable);
+	priv->ops = pGC->ops;
+	RDP_MOVE_GC_FUNC_EPILOGUE(pGC);
+}
+
+static void rdpMoveChangeGC(GCPtr pGC, unsigned long mask)
+{
+	RDP_MOVE_GC_FUNC_PROLOGUE(pGC);
+	pGC->funcs->ChangeGC(pGC, mask);
+	RDP_MOVE_GC_FUNC_EPILOGUE(pGC);
+}
+
+static void rdpMoveCopyGC(GCPtr pGCSrc, unsigned long mask, GCPtr pGCDst)
+{
+	RDP_MOVE_GC_FUNC_PROLOGUE(pGCDst);
+	pGCDst->funcs->CopyGC(pGCSrc, mask, pGCDst);
+	RDP_MOVE_GC_FUNC_EPILOGUE(pGCDst);
+}
+
+static void rdpMoveDestroyGC(GCPtr pGC)
+{
+	RDP_MOVE_GC_FUNC_PROLOGUE(pGC);
+	pGC->funcs->DestroyGC(pGC);
+	RDP_MOVE_GC_FUNC_EPILOGUE(pGC);
+}
+
+static void rdpMoveChangeClip(GCPtr pGC, int type, void* pValue, int nrects)
+{
+	RDP_MOVE_GC_FUNC_PROLOGUE(pGC);
+	pGC->funcs->ChangeClip(pGC, type, pValue, nrects);
+	RDP_MOVE_GC_FUNC_EPILOGUE(pGC);
+}
+
+static void rdpMoveDestroyClip(GCPtr pGC)
+{
+	RDP_MOVE_GC_FUNC_PROLOGUE(pGC);
+	pGC->funcs->DestroyClip(pGC);
+	RDP_MOVE_GC_FUNC_EPILOGUE(pGC);
+}
+
+static void rdpMoveCopyClip(GCPtr pGCDst, GCPtr pGCSrc)
+{
+	RDP_MOVE_GC_FUNC_PROLOGUE(pGCDst);
+	pGCDst->funcs->CopyClip(pGCDst, pGCSrc);
+	RDP_MOVE_GC_FUNC_EPILOGUE(pGCDst);
+}
+
+static Bool rdpMoveCreateGC(GCPtr pGC)
+{
+	ScreenPtr pScreen = pGC->pScreen;
+	rdpMoveGCPrivPtr priv = rdpMoveGetGCPriv(pGC);
+	Bool ret;
+
+	pScreen->CreateGC = g_moveCreateGC;
+	ret = pScreen->CreateGC(pGC);
+	pScreen->CreateGC = rdpMoveCreateGC;
+
+	if (ret)
+	{
+		priv->ops = NULL;
+		priv->funcs = pGC->funcs;
+		pGC->funcs = &g_moveGCFuncs;
+	}
+
+	return ret;
+}
+
+static void rdpMoveCopyWindow(WindowPtr pWin, DDXPointRec ptOldOrg, RegionPtr prgnSrc)
+{
+	ScreenPtr pScreen = pWin->drawable.pScreen;
+	RegionRec moved;
+	int dx = pWin->drawable.x - ptOldOrg.x;
+	int dy = pWin->drawable.y - ptOldOrg.y;
+
+	if (rdpMoveIsOnScreen(&pWin->drawable))
+	{
+		/* prgnSrc is in source coordinates */
+		RegionNull(&moved);
+		RegionCopy(&moved, prgnSrc);
+		RegionTranslate(&moved, dx, dy);
+		RegionIntersect(&moved, &moved, &pWin->borderClip);
+		rdpMoveRecord(&moved, dx, dy);
+		RegionUninit(&moved);
+	}
+
+	pScreen->CopyWindow = g_moveCopyWindow;
+	pScreen->CopyWindow(pWin, ptOldOrg, prgnSrc);
+	pScreen->CopyWindow = rdpMoveCopyWindow;
+}
+
+/* must be called after DamageSetup() */
+Bool rdpMoveInit(ScreenPtr pScreen)
+{
+	if (!dixRegisterPrivateKey(&g_moveGCKeyRec, PRIVATE_GC, sizeof(rdpMoveGCPrivRec)))
+		return FALSE;
+
+	g_moveCreateGC = pScreen->CreateGC;
+	pScreen->CreateGC = rdpMoveCreateGC;
+
+	g_moveCopyWindow = pScreen->CopyWindow;
+	pScreen->CopyWindow = rdpMoveCopyWindow;
+
+	rdpMoveReset();
+
+	return TRUE;
+}
+
+/**
+ * Hand out the moves recorded since the last call, the list stays valid
+ * until the next drawing operation.
+ */
+int rdpMoveTake(rdpMoveRec** moves)
+{
+	int numMoves = g_numMoves;
+
+	*moves = g_moves;
+	rdpMoveReset();
+
+	return numMoves;
+}
+
+/* drop all recorded moves, e.g. when full damage is sent */
+void rdpMoveReset(void)
+{
+	g_numMoves = 0;
+	g_movesOverflow = FALSE;
+}
@@ -91,11 +91,8 @@ static Bool rdpRRGetInfo(ScreenPtr pScreen, Rotation* pRotations)
 
 static Bool rdpRRScreenSetSize(ScreenPtr pScreen, CARD16 width, CARD16 height, CARD32 mmWidth, CARD32 mmHeight)
 {
-	BoxRec box;
-	WindowPtr pRoot;
 	PixmapPtr screenPixmap;
 	rdpRandRInfoPtr randr;
-	BOOL recreatefb = FALSE;
 
 	LLOGLN(0, ("rdpRRScreenSetSize: width: %d height: %d mmWidth: %d mmHeight: %d",
 			width, height, mmWidth, mmHeight));
@@ -108,6 +105,18 @@ static Bool rdpRRScreenSetSize(ScreenPtr pScreen, CARD16 width, CARD16 height, C
 	if ((width < 1) || (height < 1))
 		return FALSE;
 
+	/**
+	 * The framebuffer content is kept across the resize, so the root clip
+	 * stays enabled: validating the tree against the new root size only
+	 * exposes the areas which were not visible before instead of making
+	 * every client repaint all of its windows.
+	 */
+	if ((pScreen->width != width || pScreen->height != height) &&
+			!rdpScreenResizeFrameBuffer(width, height))
+	{
+		return FALSE;
+	}
+
 	randr->width = width;
 	randr->height = height;
 	randr->mmWidth = mmWidth;
@@ -115,16 +124,6 @@ static Bool rdpRRScreenSetSize(ScreenPtr pScreen, CARD16 width, CARD16 height, C
 
 	rdpModeSelect(pScreen, randr->width, randr->height);
 
-	SetRootClip(pScreen, FALSE);
-
-	pRoot = pScreen->root;
-
-	if (pScreen->width != width || pScreen->height != height)
-		recreatefb = TRUE;
-
-	g_rdpScreen.width = width;
-	g_rdpScreen.height = height;
-
 	pScreen->x = 0;
 	pScreen->y = 0;
 	pScreen->width = width;
@@ -137,11 +136,6 @@ static Bool rdpRRScreenSetSize(ScreenPtr pScreen, CARD16 width, CARD16 height, C
 	screenInfo.width = width;
 	screenInfo.height = height;
 
-	if (recreatefb && !rdpScreenRecreateFrameBuffer())
-	{
-		return FALSE;
-	}
-
 	screenPixmap = pScreen->GetScreenPixmap(pScreen);
 
 	if (screenPixmap)
@@ -151,27 +145,10 @@ static Bool rdpRRScreenSetSize(ScreenPtr pScreen, CARD16 width, CARD16 height, C
 				g_rdpScreen.scanline, g_rdpScreen.pfbMemory);
 	}
 
-	box.x1 = 0;
-	box.y1 = 0;
-	box.x2 = width;
-	box.y2 = height;
-
-	RegionInit(&pRoot->winSize, &box, 1);
-	RegionInit(&pRoot->borderSize, &box, 1);
-	RegionReset(&pRoot->borderClip, &box);
-	RegionBreak(&pRoot->clipList);
-
-	pRoot->drawable.width = width;
-	pRoot->drawable.height = height;
-
-	ResizeChildrenWinSize(pRoot, 0, 0, 0, 0);
-
 	RRGetInfo(pScreen, TRUE);
 
 	SetRootClip(pScreen, TRUE);
 
-	miPaintWindow(pRoot, &pRoot->borderClip, PW_BACKGROUND);
-
 	RRScreenSizeNotify(pScreen);
 
 	return TRUE;
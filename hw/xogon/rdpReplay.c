@@ -0,0 +1,327 @@
+/**
+ * ogon Remote Desktop Services
+ * X11 backend
+ *
+ * Copyright (C) 2013-2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * Damage trace replay
+ *
+ * Replays a damage trace recorded with -damagetrace through the
+ * rectangle merging and the damage copy engine of the backend, in process,
+ * and reports frames/s, copy bandwidth and the merge and copy time per
+ * frame. There is no ogon endpoint and no damage buffer sync round trip,
+ * the times are a lower bound for the sync latency of a real session.
+ * Not built by default, use "make rdp-damage-replay" in hw/xogon.
+ *
+ * usage: rdp-damage-replay [-t threads] [-m merge%] [-k kernel] [-l loops] [-r] trace
+ */
+
+#include "rdp.h"
+#include "rdpCopy.h"
+#include "rdpMerge.h"
+#include "rdpTrace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct _replayFrame
+{
+	UINT64 time;
+	int width;
+	int height;
+	int bytesPerPixel;
+	int maxRects;
+	int firstBox;
+	int numBoxes;
+} replayFrame;
+
+static replayFrame* g_frames = NULL;
+static int g_numFrames = 0;
+static BoxRec* g_boxes = NULL;
+static int g_numBoxes = 0;
+
+static void* replayGrow(void* array, int count, int* size, size_t elementSize)
+{
+	void* ptr;
+
+	if (count < *size)
+		return array;
+
+	*size = *size ? *size * 2 : 1024;
+	ptr = realloc(array, *size * elementSize);
+
+	if (!ptr)
+	{
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	return ptr;
+}
+
+static BOOL replayLoad(const char* path)
+{
+	FILE* fp;
+	char line[256];
+	char magic[64];
+	unsigned long long time;
+	int version, width = 0, height = 0, bpp = 0;
+	int x1, y1, x2, y2, maxRects, numBoxes;
+	int framesSize = 0, boxesSize = 0;
+	replayFrame* frame = NULL;
+
+	if (!(fp = fopen(path, "r")))
+	{
+		fprintf(stderr, "failed to open %s\n", path);
+		return FALSE;
+	}
+
+	while (fgets(line, sizeof(line), fp))
+	{
+		if (sscanf(line, "R %d %d %d %d", &x1, &y1, &x2, &y2) == 4 && frame)
+		{
+			g_boxes = replayGrow(g_boxes, g_numBoxes, &boxesSize, sizeof(BoxRec));
+			g_boxes[g_numBoxes].x1 = x1;
+			g_boxes[g_numBoxes].y1 = y1;
+			g_boxes[g_numBoxes].x2 = x2;
+			g_boxes[g_numBoxes].y2 = y2;
+			g_numBoxes++;
+			frame->numBoxes++;
+		}
+		else if (sscanf(line, "F %llu %d %d", &time, &maxRects, &numBoxes) == 3 && width > 0)
+		{
+			g_frames = replayGrow(g_frames, g_numFrames, &framesSize, sizeof(replayFrame));
+			frame = &g_frames[g_numFrames++];
+			frame->time = time;
+			frame->width = width;
+			frame->height = height;
+			frame->bytesPerPixel = bpp;
+			frame->maxRects = maxRects;
+			frame->firstBox = g_numBoxes;
+			frame->numBoxes = 0;
+		}
+		else if (sscanf(line, "%63s %d %d %d %d", magic, &version, &width, &height, &bpp) == 5 &&
+				!strcmp(magic, RDP_TRACE_MAGIC) && version == RDP_TRACE_VERSION)
+		{
+			frame = NULL;
+		}
+		else
+		{
+			fprintf(stderr, "invalid trace line: %s", line);
+			fclose(fp);
+			return FALSE;
+		}
+	}
+
+	fclose(fp);
+
+	return g_numFrames > 0;
+}
+
+static double replayNow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int replayCompare(const void* a, const void* b)
+{
+	double da = *(const double*) a;
+	double db = *(const double*) b;
+
+	return (da > db) - (da < db);
+}
+
+static void usage(const char* name)
+{
+	fprintf(stderr, "usage: %s [-t threads] [-m merge%%] [-k auto|scalar|sse2|avx2] [-l loops] [-r] trace\n", name);
+	fprintf(stderr, "times rectangle merging and the damage copy in process, without an ogon endpoint\n");
+	exit(1);
+}
+
+int main(int argc, char** argv)
+{
+	int threads = 1;
+	int mergeWaste = 10;
+	int kernel = RDP_COPY_KERNEL_AUTO;
+	int loops = 1;
+	BOOL realtime = FALSE;
+	int opt, i, j, loop, numRects, scanline, mod;
+	size_t size, maxSize = 0;
+	char* src;
+	char* dst;
+	BoxPtr rects;
+	rdpCopyRect* copyRects;
+	replayFrame* frame;
+	double* frameTimes;
+	double start, frameStart, copyStart, elapsed, traceStart = 0;
+	double mergeTime = 0, copyTime = 0;
+	UINT64 bytes = 0, rectsIn = 0, rectsOut = 0;
+
+	while ((opt = getopt(argc, argv, "t:m:k:l:r")) != -1)
+	{
+		switch (opt)
+		{
+			case 't':
+				threads = atoi(optarg);
+				break;
+			case 'm':
+				mergeWaste = atoi(optarg);
+				break;
+			case 'k':
+				for (kernel = RDP_COPY_KERNEL_AUTO; kernel <= RDP_COPY_KERNEL_AVX2; kernel++)
+				{
+					if (!strcmp(optarg, rdpCopyKernelName(kernel)))
+						break;
+				}
+				if (kernel > RDP_COPY_KERNEL_AVX2)
+					usage(argv[0]);
+				break;
+			case 'l':
+				loops = atoi(optarg);
+				break;
+			case 'r':
+				realtime = TRUE;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+
+	if (optind + 1 != argc || threads < 1 || loops < 1)
+		usage(argv[0]);
+
+	if (!replayLoad(argv[optind]))
+	{
+		fprintf(stderr, "no frames in %s\n", argv[optind]);
+		return 1;
+	}
+
+	for (i = 0; i < g_numFrames; i++)
+	{
+		scanline = g_frames[i].width * g_frames[i].bytesPerPixel;
+		scanline += ((mod = scanline % 16)) ? 16 - mod : 0;
+		size = (size_t) scanline * g_frames[i].height;
+		maxSize = max(maxSize, size);
+	}
+
+	src = malloc(maxSize);
+	dst = malloc(maxSize);
+	copyRects = malloc(max(g_numBoxes, 1) * sizeof(rdpCopyRect));
+	frameTimes = malloc((size_t) g_numFrames * loops * sizeof(double));
+
+	if (!src || !dst || !copyRects || !frameTimes)
+	{
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	memset(src, 0x5a, maxSize);
+	memset(dst, 0, maxSize);
+
+	if (rdpCopyInit(threads) < 0)
+		fprintf(stderr, "failed to start all copy threads\n");
+
+	kernel = rdpCopySetKernel(kernel);
+
+	start = replayNow();
+
+	for (loop = 0; loop < loops; loop++)
+	{
+		traceStart = replayNow();
+
+		for (i = 0; i < g_numFrames; i++)
+		{
+			frame = &g_frames[i];
+
+			if (realtime)
+			{
+				/* wait until the frame was due in the recorded session */
+				elapsed = replayNow() - traceStart;
+
+				if ((frame->time - g_frames[0].time) / 1e6 > elapsed)
+					usleep(((frame->time - g_frames[0].time) / 1e6 - elapsed) * 1e6);
+			}
+
+			scanline = frame->width * frame->bytesPerPixel;
+			scanline += ((mod = scanline % 16)) ? 16 - mod : 0;
+
+			frameStart = replayNow();
+
+			numRects = rdpMergeBoxes(&g_boxes[frame->firstBox], frame->numBoxes,
+					frame->maxRects, mergeWaste, &rects);
+
+			for (j = 0; j < numRects; j++)
+			{
+				copyRects[j].x = rects[j].x1;
+				copyRects[j].y = rects[j].y1;
+				copyRects[j].width = rects[j].x2 - rects[j].x1;
+				copyRects[j].height = rects[j].y2 - rects[j].y1;
+				bytes += (UINT64) copyRects[j].width * copyRects[j].height * frame->bytesPerPixel;
+			}
+
+			copyStart = replayNow();
+			rdpCopyRects(dst, src, frame->width, scanline, frame->bytesPerPixel,
+					copyRects, numRects);
+
+			frameTimes[loop * g_numFrames + i] = replayNow() - frameStart;
+			mergeTime += copyStart - frameStart;
+			copyTime += frameTimes[loop * g_numFrames + i] - (copyStart - frameStart);
+			rectsIn += frame->numBoxes;
+			rectsOut += numRects;
+		}
+	}
+
+	elapsed = replayNow() - start;
+
+	qsort(frameTimes, (size_t) g_numFrames * loops, sizeof(double), replayCompare);
+
+	printf("frames:      %d x %d loops, %s kernel, %d threads, merge %d%%\n",
+			g_numFrames, loops, rdpCopyKernelName(kernel), threads, mergeWaste);
+	printf("rects:       %.1f per frame in, %.1f out\n",
+			(double) rectsIn / (g_numFrames * loops), (double) rectsOut / (g_numFrames * loops));
+	printf("throughput:  %.1f frames/s, %.2f GB/s copied\n",
+			g_numFrames * loops / elapsed, bytes / elapsed / 1e9);
+	printf("merge+copy:  p50 %.1f us, p99 %.1f us, max %.1f us per frame\n",
+			frameTimes[(size_t) g_numFrames * loops / 2] * 1e6,
+			frameTimes[(size_t) g_numFrames * loops * 99 / 100] * 1e6,
+			frameTimes[(size_t) g_numFrames * loops - 1] * 1e6);
+	printf("split:       %.1f us merge, %.1f us copy per frame on average\n",
+			mergeTime / (g_numFrames * loops) * 1e6, copyTime / (g_numFrames * loops) * 1e6);
+
+	rdpCopyUninit();
+
+	free(frameTimes);
+	free(copyRects);
+	free(src);
+	free(dst);
+	free(g_boxes);
+	free(g_frames);
+
+	return 0;
+}
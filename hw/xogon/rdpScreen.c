@@ -37,6 +37,10 @@
 #include <sys/stat.h>
 
 extern rdpScreenInfoRec g_rdpScreen;
+extern ScreenPtr g_pScreen;
+
+/* allocated size of the private framebuffer, may exceed sizeInBytes */
+static int g_fbCapacity = 0;
 
 int get_min_shared_memory_segment_size(void)
 {
@@ -83,10 +87,34 @@ int rdpScreenPixelToMM(int pixels)
 	return ((int)(((((double)(pixels)) / g_rdpScreen.dpi) * 25.4)));
 }
 
-Bool rdpScreenCreateFrameBuffer(void)
+static int rdpScreenScanline(int width)
+{
+	int scanline, mod;
+
+	scanline = width * g_rdpScreen.bytesPerPixel;
+	scanline += ((mod = scanline % 16)) ? 16 - mod : 0;
+
+	return scanline;
+}
+
+static void rdpScreenUpdateScreenRec(void)
 {
 	BoxRec screenBox;
-	int mod;
+
+	if (g_rdpScreen.x11Damage)
+	{
+		RegionUninit(&g_rdpScreen.screenRec);
+	}
+
+	screenBox.x1 = 0;
+	screenBox.y1 = 0;
+	screenBox.x2 = g_rdpScreen.width;
+	screenBox.y2 = g_rdpScreen.height;
+	RegionInit(&g_rdpScreen.screenRec, &screenBox, 1);
+}
+
+Bool rdpScreenCreateFrameBuffer(void)
+{
 
 	if (g_rdpScreen.pfbMemory != NULL)
 	{
@@ -97,8 +125,7 @@ Bool rdpScreenCreateFrameBuffer(void)
 	g_rdpScreen.bitsPerPixel = rdpScreenBitsPerPixel(g_rdpScreen.depth);
 	g_rdpScreen.bytesPerPixel = g_rdpScreen.bitsPerPixel / 8;
 
-	g_rdpScreen.scanline = g_rdpScreen.width * g_rdpScreen.bytesPerPixel;
-	g_rdpScreen.scanline += ((mod = g_rdpScreen.scanline % 16)) ? 16 - mod : 0;
+	g_rdpScreen.scanline = rdpScreenScanline(g_rdpScreen.width);
 
 	g_rdpScreen.sizeInBytes = (g_rdpScreen.scanline * g_rdpScreen.height);
 
@@ -110,17 +137,9 @@ Bool rdpScreenCreateFrameBuffer(void)
 		return FALSE;
 	}
 	memset(g_rdpScreen.pfbMemory, 0, g_rdpScreen.sizeInBytes);
+	g_fbCapacity = g_rdpScreen.sizeInBytes;
 
-	if (g_rdpScreen.x11Damage)
-	{
-		RegionUninit(&g_rdpScreen.screenRec);
-	}
-
-	screenBox.x1 = 0;
-	screenBox.y1 = 0;
-	screenBox.x2 = g_rdpScreen.width;
-	screenBox.y2 = g_rdpScreen.height;
-	RegionInit(&g_rdpScreen.screenRec, &screenBox, 1);
+	rdpScreenUpdateScreenRec();
 
 	rdp_send_framebuffer_info();
 
@@ -135,15 +154,178 @@ Bool rdpScreenDestroyFrameBuffer(void)
 		return FALSE;
 	}
 
+	if (g_rdpScreen.fbShared)
+	{
+		/* the memory belongs to the damage buffer, just drop our reference */
+		g_rdpScreen.pfbMemory = NULL;
+		g_rdpScreen.fbShared = FALSE;
+		rdp_detach_rds_framebuffer();
+		return TRUE;
+	}
+
 	rdp_detach_rds_framebuffer();
 
 	free(g_rdpScreen.pfbMemory);
 	g_rdpScreen.pfbMemory = NULL;
+	g_fbCapacity = 0;
+
+	return TRUE;
+}
+
+/**
+ * Change the framebuffer to width x height keeping the content of the area
+ * both sizes have in common, newly revealed pixels are cleared. If the
+ * private framebuffer is large enough the rows are moved in place to the
+ * new scanline, otherwise it grows by at least half of its size so a
+ * series of resizes (dragging the client window) reallocates rarely.
+ * A shared framebuffer is copied into private memory first as the damage
+ * buffers are sized for the old geometry and get detached.
+ */
+Bool rdpScreenResizeFrameBuffer(int width, int height)
+{
+	char* data = g_rdpScreen.pfbMemory;
+	int oldScanline = g_rdpScreen.scanline;
+	int scanline, size, capacity, rowBytes, rows, y;
+
+	if (!data)
+	{
+		ErrorF("rdpScreenResizeFrameBuffer error pfbMemory: %p\n", data);
+		return FALSE;
+	}
+
+	scanline = rdpScreenScanline(width);
+	size = scanline * height;
+	rows = MIN(height, g_rdpScreen.height);
+	rowBytes = MIN(width, g_rdpScreen.width) * g_rdpScreen.bytesPerPixel;
+
+	if (g_rdpScreen.fbShared || size > g_fbCapacity)
+	{
+		capacity = size;
+
+		if (!g_rdpScreen.fbShared)
+			capacity = MAX(size, g_fbCapacity + g_fbCapacity / 2);
+
+		data = (char*) malloc(capacity);
+
+		if (!data)
+		{
+			ErrorF("rdpScreenResizeFrameBuffer: pfbMemory creation failed\n");
+			return FALSE;
+		}
+
+		for (y = 0; y < rows; y++)
+			memcpy(data + y * scanline, g_rdpScreen.pfbMemory + y * oldScanline, rowBytes);
+
+		if (!g_rdpScreen.fbShared)
+			free(g_rdpScreen.pfbMemory);
+
+		g_rdpScreen.fbShared = FALSE;
+		g_fbCapacity = capacity;
+	}
+	else if (scanline > oldScanline)
+	{
+		/* rows move towards the end, start with the last one */
+		for (y = rows - 1; y > 0; y--)
+			memmove(data + y * scanline, data + y * oldScanline, rowBytes);
+	}
+	else if (scanline < oldScanline)
+	{
+		for (y = 1; y < rows; y++)
+			memmove(data + y * scanline, data + y * oldScanline, rowBytes);
+	}
+
+	for (y = 0; y < rows; y++)
+		memset(data + y * scanline + rowBytes, 0, scanline - rowBytes);
+
+	memset(data + rows * scanline, 0, (height - rows) * scanline);
+
+	g_rdpScreen.pfbMemory = data;
+	g_rdpScreen.width = width;
+	g_rdpScreen.height = height;
+	g_rdpScreen.scanline = scanline;
+	g_rdpScreen.sizeInBytes = size;
+
+	rdp_detach_rds_framebuffer();
+
+	rdpScreenUpdateScreenRec();
+
+	rdp_send_framebuffer_info();
+
+	return TRUE;
+}
+
+static void rdpScreenSetPixmapData(char* data)
+{
+	PixmapPtr screenPixmap;
+
+	if (!g_pScreen)
+		return;
+
+	screenPixmap = g_pScreen->GetScreenPixmap(g_pScreen);
+
+	if (!screenPixmap)
+		return;
+
+	g_pScreen->ModifyPixmapHeader(screenPixmap, g_rdpScreen.width, g_rdpScreen.height,
+			g_rdpScreen.depth, g_rdpScreen.bitsPerPixel,
+			g_rdpScreen.scanline, data);
+}
+
+/**
+ * Let the screen pixmap render directly into data (the ogon damage buffer).
+ * The current screen content is copied once and the private framebuffer is
+ * released until rdpScreenUnshareFrameBuffer() is called.
+ */
+Bool rdpScreenShareFrameBuffer(char* data, unsigned int size)
+{
+	if (!data || !g_rdpScreen.pfbMemory || g_rdpScreen.fbShared)
+		return FALSE;
+
+	if (size < g_rdpScreen.sizeInBytes)
+	{
+		ErrorF("rdpScreenShareFrameBuffer: damage buffer too small (%u < %d)\n",
+				size, g_rdpScreen.sizeInBytes);
+		return FALSE;
+	}
+
+	memcpy(data, g_rdpScreen.pfbMemory, g_rdpScreen.sizeInBytes);
+	free(g_rdpScreen.pfbMemory);
+	g_fbCapacity = 0;
+
+	g_rdpScreen.pfbMemory = data;
+	g_rdpScreen.fbShared = TRUE;
+
+	rdpScreenSetPixmapData(data);
 
 	return TRUE;
 }
 
-Bool rdpScreenRecreateFrameBuffer(void)
+/**
+ * Move the screen pixmap back to a private framebuffer. Must be called
+ * before the shared damage buffer gets unmapped.
+ */
+Bool rdpScreenUnshareFrameBuffer(void)
 {
-	return ( rdpScreenDestroyFrameBuffer() && rdpScreenCreateFrameBuffer() );
+	char* data;
+
+	if (!g_rdpScreen.fbShared)
+		return TRUE;
+
+	data = (char*) malloc(g_rdpScreen.sizeInBytes);
+
+	if (!data)
+	{
+		ErrorF("rdpScreenUnshareFrameBuffer: pfbMemory creation failed\n");
+		return FALSE;
+	}
+
+	memcpy(data, g_rdpScreen.pfbMemory, g_rdpScreen.sizeInBytes);
+
+	g_rdpScreen.pfbMemory = data;
+	g_rdpScreen.fbShared = FALSE;
+	g_fbCapacity = g_rdpScreen.sizeInBytes;
+
+	rdpScreenSetPixmapData(data);
+
+	return TRUE;
 }
@@ -35,7 +35,9 @@ int rdpScreenPixelToMM(int pixels);
 
 Bool rdpScreenCreateFrameBuffer(void);
 Bool rdpScreenDestroyFrameBuffer(void);
-Bool rdpScreenRecreateFrameBuffer(void);
+Bool rdpScreenResizeFrameBuffer(int width, int height);
+Bool rdpScreenShareFrameBuffer(char* data, unsigned int size);
+Bool rdpScreenUnshareFrameBuffer(void);
 
 int get_min_shared_memory_segment_size(void);
 int get_max_shared_memory_segment_size(void);
@@ -0,0 +1,156 @@
+/**
+ * ogon Remote Desktop Services
+ * X11 backend
+ *
+ * Copyright (C) 2013-2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * Standby servers
+ *
+ * Started with -standby <fd> the server initializes completely but neither
+ * listens for X clients nor binds the ogon service endpoint, it has no
+ * display number yet. A session manager can keep a few of these around and
+ * assign a display to one of them at login by writing the number followed
+ * by a newline to fd. The server then takes the lock file and the X sockets
+ * of that display, binds the endpoint and answers with the display number
+ * and a newline, like -displayfd does. The fd is closed afterwards.
+ */
+
+#include "rdp.h"
+#include "rdpStandby.h"
+
+#include <ctype.h>
+#include <fcntl.h>
+
+extern int g_standbyFd;
+
+static Bool g_standbyActive = FALSE;
+static char g_standbyDisplay[8];
+static char g_standbyBuffer[16];
+static char g_standbyKeymap[32];
+static int g_standbyLength = 0;
+
+/* whether the server was started in standby and has no display yet */
+Bool rdpStandbyWaiting(void)
+{
+	return g_standbyFd >= 0 && !g_standbyActive;
+}
+
+static Bool rdpStandbyActivate(const char* number)
+{
+	int i;
+
+	for (i = 0; number[i]; i++)
+	{
+		if (!isdigit(number[i]))
+			return FALSE;
+	}
+
+	if (i == 0 || i >= sizeof(g_standbyDisplay) || atoi(number) < 1)
+		return FALSE;
+
+	strcpy(g_standbyDisplay, number);
+	display = g_standbyDisplay;
+	explicit_display = TRUE;
+	XkbKeymapOutputName = NULL;
+
+	if (!ListenOnDisplay())
+	{
+		ErrorF("rdpStandbyActivate: unable to listen on display %s\n", display);
+		return FALSE;
+	}
+
+	g_standbyActive = TRUE;
+
+	/* sets DISPLAY and binds the service endpoint */
+	return rdp_init();
+}
+
+static void rdpStandbyNotify(int fd, int ready, void* data)
+{
+	char reply[sizeof(g_standbyDisplay) + 1];
+	char* end;
+	int length;
+
+	length = read(fd, g_standbyBuffer + g_standbyLength,
+			sizeof(g_standbyBuffer) - 1 - g_standbyLength);
+
+	if (length < 0 && (errno == EAGAIN || errno == EINTR))
+		return;
+
+	if (length <= 0)
+		FatalError("rdpStandbyNotify: standby fd closed before a display was assigned\n");
+
+	g_standbyLength += length;
+	g_standbyBuffer[g_standbyLength] = '\0';
+
+	if (!(end = strchr(g_standbyBuffer, '\n')))
+	{
+		if (g_standbyLength == sizeof(g_standbyBuffer) - 1)
+			FatalError("rdpStandbyNotify: invalid display assignment\n");
+
+		return;
+	}
+
+	*end = '\0';
+
+	RemoveNotifyFd(g_standbyFd);
+
+	if (!rdpStandbyActivate(g_standbyBuffer))
+		FatalError("rdpStandbyNotify: unable to activate display %s\n", g_standbyBuffer);
+
+	ErrorF("rdpStandbyNotify: activated on display %s\n", display);
+
+	length = snprintf(reply, sizeof(reply), "%s\n", display);
+
+	if (write(g_standbyFd, reply, length) != length)
+		ErrorF("rdpStandbyNotify: unable to confirm display %s\n", display);
+
+	close(g_standbyFd);
+	g_standbyFd = -1;
+}
+
+void rdpStandbyInit(void)
+{
+	static Bool registered = FALSE;
+
+	if (g_standbyFd < 0)
+		return;
+
+	/**
+	 * Until activation display is still the default, all pooled servers
+	 * and a real :0 would compile their keymaps to server-0.xkm at once.
+	 */
+	snprintf(g_standbyKeymap, sizeof(g_standbyKeymap), "standby-%ld", (long) getpid());
+	XkbKeymapOutputName = g_standbyKeymap;
+
+	if (registered)
+		return;
+
+	/* not for xkbcomp and the programs started by the helper */
+	fcntl(g_standbyFd, F_SETFD, FD_CLOEXEC);
+
+	SetNotifyFd(g_standbyFd, rdpStandbyNotify, X_NOTIFY_READ, NULL);
+	registered = TRUE;
+
+	ErrorF("rdpStandbyInit: waiting for a display on fd %d\n", g_standbyFd);
+}
@@ -0,0 +1,278 @@
+/**
+ * ogon Remote Desktop Services
+ * X11 backend
+ *
+ * Copyright (C) 2013-2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * Frame pipeline statistics
+ *
+ * Counters and latency histograms for the frame path. Updates are atomic
+ * so they can also be done from the damage copy threads. Histograms use
+ * HDR style buckets: exact below 8, above that 4 buckets per power of two,
+ * which keeps the relative error of percentiles below 25%.
+ *
+ * With -statsinterval N the statistics of the last N seconds are logged
+ * and published in the _OGON_BACKEND_STATS property of the root window,
+ * then reset. Times are in microseconds. The read counters of the X client
+ * connections are added from the os layer.
+ */
+
+#include "rdp.h"
+#include "rdpStats.h"
+
+#include "property.h"
+#include "windowstr.h"
+
+#include <stdio.h>
+
+#define RDP_STATS_SUB_BITS	2
+#define RDP_STATS_LINEAR	(1 << (RDP_STATS_SUB_BITS + 1))
+#define RDP_STATS_BUCKETS	(RDP_STATS_LINEAR + (64 - RDP_STATS_SUB_BITS - 1) * (1 << RDP_STATS_SUB_BITS))
+
+#define RDP_STATS_PROPERTY	"_OGON_BACKEND_STATS"
+
+typedef struct _rdpStatsHistogramRec
+{
+	UINT64 buckets[RDP_STATS_BUCKETS];
+	UINT64 count;
+	UINT64 max;
+} rdpStatsHistogramRec;
+
+static const char* g_counterNames[RDP_STATS_NUM_COUNTERS] =
+{
+	"frames", "rects", "bytes", "sync_requests", "input_events",
+	"motion_coalesced", "moves", "moved_pixels"
+};
+
+static const char* g_histogramNames[RDP_STATS_NUM_HISTOGRAMS] =
+{
+	"rects_per_frame", "damage_us", "sync_latency_us", "input_latency_us"
+};
+
+extern ScreenPtr g_pScreen;
+
+int g_statsInterval = 0;
+
+static UINT64 g_counters[RDP_STATS_NUM_COUNTERS];
+static rdpStatsHistogramRec g_histograms[RDP_STATS_NUM_HISTOGRAMS];
+
+static CARD64 g_statsSyncRequestTime = 0;
+static CARD64 g_statsInputTime = 0;
+static OsTimerPtr g_statsTimer = NULL;
+
+static int rdpStatsBucket(UINT64 value)
+{
+	int msb;
+
+	if (value < RDP_STATS_LINEAR)
+		return (int) value;
+
+	msb = 63 - __builtin_clzll(value);
+
+	return RDP_STATS_LINEAR + (msb - RDP_STATS_SUB_BITS - 1) * (1 << RDP_STATS_SUB_BITS) +
+		(int) ((value >> (msb - RDP_STATS_SUB_BITS)) & ((1 << RDP_STATS_SUB_BITS) - 1));
+}
+
+/* highest value falling into bucket */
+static UINT64 rdpStatsBucketValue(int bucket)
+{
+	int msb, sub;
+
+	if (bucket < RDP_STATS_LINEAR)
+		return bucket;
+
+	bucket -= RDP_STATS_LINEAR;
+	msb = bucket / (1 << RDP_STATS_SUB_BITS) + RDP_STATS_SUB_BITS + 1;
+	sub = bucket % (1 << RDP_STATS_SUB_BITS);
+
+	return ((UINT64) ((1 << RDP_STATS_SUB_BITS) + sub + 1) << (msb - RDP_STATS_SUB_BITS)) - 1;
+}
+
+void rdpStatsAdd(rdpStatsCounter counter, UINT64 value)
+{
+	__atomic_fetch_add(&g_counters[counter], value, __ATOMIC_RELAXED);
+}
+
+void rdpStatsRecord(rdpStatsHistogram histogram, UINT64 value)
+{
+	rdpStatsHistogramRec* h = &g_histograms[histogram];
+	UINT64 max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+
+	__atomic_fetch_add(&h->buckets[rdpStatsBucket(value)], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+
+	while (value > max && !__atomic_compare_exchange_n(&h->max, &max, value,
+			TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void rdpStatsSyncRequested(void)
+{
+	rdpStatsAdd(RDP_STATS_SYNC_REQUESTS, 1);
+
+	if (!g_statsSyncRequestTime)
+		g_statsSyncRequestTime = GetTimeInMicros();
+}
+
+/* only the first input event since the last frame is timed */
+void rdpStatsInputEvent(void)
+{
+	rdpStatsAdd(RDP_STATS_INPUT_EVENTS, 1);
+
+	if (!g_statsInputTime)
+		g_statsInputTime = GetTimeInMicros();
+}
+
+void rdpStatsFrameSent(void)
+{
+	CARD64 now = GetTimeInMicros();
+
+	rdpStatsAdd(RDP_STATS_FRAMES, 1);
+
+	if (g_statsSyncRequestTime)
+	{
+		rdpStatsRecord(RDP_STATS_SYNC_LATENCY, now - g_statsSyncRequestTime);
+		g_statsSyncRequestTime = 0;
+	}
+
+	if (g_statsInputTime)
+	{
+		rdpStatsRecord(RDP_STATS_INPUT_LATENCY, now - g_statsInputTime);
+		g_statsInputTime = 0;
+	}
+}
+
+static UINT64 rdpStatsPercentile(const rdpStatsHistogramRec* h, UINT64 count, int percent)
+{
+	UINT64 seen = 0;
+	UINT64 rank = (count * percent + 99) / 100;
+	int i;
+
+	for (i = 0; i < RDP_STATS_BUCKETS; i++)
+	{
+		seen += h->buckets[i];
+
+		if (seen >= rank && seen > 0)
+			return min(rdpStatsBucketValue(i), h->max);
+	}
+
+	return h->max;
+}
+
+/**
+ * Print the statistics as "name=value" pairs into buffer. Returns the
+ * length of the string.
+ */
+int rdpStatsFormat(char* buffer, int size)
+{
+	const rdpStatsHistogramRec* h;
+	OsInputStatsRec input;
+	int i, len = 0;
+
+	buffer[0] = '\0';
+
+	for (i = 0; i < RDP_STATS_NUM_COUNTERS && len < size; i++)
+	{
+		len += snprintf(buffer + len, size - len, "%s%s=%llu", len ? " " : "",
+				g_counterNames[i], (unsigned long long) g_counters[i]);
+	}
+
+	for (i = 0; i < RDP_STATS_NUM_HISTOGRAMS && len < size; i++)
+	{
+		h = &g_histograms[i];
+
+		len += snprintf(buffer + len, size - len, " %s=%llu/%llu/%llu/%llu",
+				g_histogramNames[i],
+				(unsigned long long) rdpStatsPercentile(h, h->count, 50),
+				(unsigned long long) rdpStatsPercentile(h, h->count, 90),
+				(unsigned long long) rdpStatsPercentile(h, h->count, 99),
+				(unsigned long long) h->max);
+	}
+
+	/* reads per request show how well client input is batched */
+	GetInputStats(&input, FALSE);
+
+	if (len < size)
+	{
+		len += snprintf(buffer + len, size - len,
+				" client_reads=%lu client_requests=%lu client_input_resizes=%lu",
+				input.reads, input.requests, input.resizes);
+	}
+
+	return min(len, size - 1);
+}
+
+static void rdpStatsPublish(void)
+{
+	char buffer[1024];
+	int len;
+
+	len = rdpStatsFormat(buffer, sizeof(buffer));
+
+	ErrorF("stats: %s\n", buffer);
+
+	if (g_pScreen && g_pScreen->root)
+	{
+		dixChangeWindowProperty(serverClient, g_pScreen->root,
+				MakeAtom(RDP_STATS_PROPERTY, strlen(RDP_STATS_PROPERTY), TRUE),
+				XA_STRING, 8, PropModeReplace, len, buffer, TRUE);
+	}
+
+	memset(g_counters, 0, sizeof(g_counters));
+	memset(g_histograms, 0, sizeof(g_histograms));
+	GetInputStats(NULL, TRUE);
+}
+
+static CARD32 rdpStatsTimerCallback(OsTimerPtr timer, CARD32 now, void* arg)
+{
+	rdpStatsPublish();
+
+	return g_statsInterval * 1000;
+}
+
+void rdpStatsInit(int interval)
+{
+	g_statsInterval = interval;
+	g_statsSyncRequestTime = 0;
+	g_statsInputTime = 0;
+
+	memset(g_counters, 0, sizeof(g_counters));
+	memset(g_histograms, 0, sizeof(g_histograms));
+	GetInputStats(NULL, TRUE);
+
+	/* the timer of the previous server generation was freed by TimerInit() */
+	g_statsTimer = NULL;
+
+	if (g_statsInterval > 0)
+	{
+		g_statsTimer = TimerSet(NULL, 0, g_statsInterval * 1000,
+				rdpStatsTimerCallback, NULL);
+	}
+}
+
+void rdpStatsUninit(void)
+{
+	if (g_statsTimer)
+		TimerFree(g_statsTimer);
+
+	g_statsTimer = NULL;
+}
@@ -0,0 +1,62 @@
+/**
+ * ogon Remote Desktop Services
+ * X11 backend
+ *
+ * Copyright (C) 2013-2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef OGON_X11RDP_STATS_H
+#define OGON_X11RDP_STATS_H
+
+typedef enum _rdpStatsCounter
+{
+	RDP_STATS_FRAMES,
+	RDP_STATS_RECTS,
+	RDP_STATS_BYTES,
+	RDP_STATS_SYNC_REQUESTS,
+	RDP_STATS_INPUT_EVENTS,
+	RDP_STATS_MOTION_COALESCED,
+	RDP_STATS_MOVES,
+	RDP_STATS_MOVED_PIXELS,
+	RDP_STATS_NUM_COUNTERS
+} rdpStatsCounter;
+
+typedef enum _rdpStatsHistogram
+{
+	RDP_STATS_RECTS_PER_FRAME,
+	RDP_STATS_DAMAGE_TIME,
+	RDP_STATS_SYNC_LATENCY,
+	RDP_STATS_INPUT_LATENCY,
+	RDP_STATS_NUM_HISTOGRAMS
+} rdpStatsHistogram;
+
+extern int g_statsInterval;
+
+void rdpStatsInit(int interval);
+void rdpStatsUninit(void);
+void rdpStatsAdd(rdpStatsCounter counter, UINT64 value);
+void rdpStatsRecord(rdpStatsHistogram histogram, UINT64 value);
+void rdpStatsSyncRequested(void);
+void rdpStatsInputEvent(void);
+void rdpStatsFrameSent(void);
+int rdpStatsFormat(char* buffer, int size);
+
+#endif /* OGON_X11RDP_STATS_H */
@@ -0,0 +1,280 @@
+/**
+ * ogon Remote Desktop Services
+ * X11 backend
+ *
+ * Copyright (C) 2013-2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * Damage tile hashing
+ *
+ * The screen is divided into 64x64 tiles and a hash of each tile's content
+ * is kept from the last frame sync. When a sync happens only the tiles
+ * touched by the damage region are rehashed, tiles whose hash did not change
+ * were repainted with identical pixels and are removed from the region so
+ * they are neither copied nor reported to ogon.
+ *
+ * This relies on the damage buffer matching the framebuffer after every
+ * sync, the table must be invalidated whenever that is not the case (new
+ * damage buffer, full damage, resize).
+ */
+
+#include "rdp.h"
+#include "rdpTiles.h"
+
+#include <string.h>
+
+#define RDP_TILE_SHIFT		6
+#define RDP_TILE_SIZE		(1 << RDP_TILE_SHIFT)
+
+#define RDP_HASH_PRIME1		0x9E3779B185EBCA87ULL
+#define RDP_HASH_PRIME2		0xC2B2AE3D27D4EB4FULL
+#define RDP_HASH_PRIME3		0x165667B19E3779F9ULL
+
+typedef struct _rdpTile
+{
+	UINT64 hash;
+	UINT32 stamp;
+	BOOL valid;
+} rdpTile;
+
+static rdpTile* g_tiles = NULL;
+static int g_tilesX = 0;
+static int g_tilesY = 0;
+static int g_tilesWidth = 0;
+static int g_tilesHeight = 0;
+static UINT32 g_tilesStamp = 0;
+
+static BoxPtr g_tilesUnchanged = NULL;
+static int g_tilesUnchangedSize = 0;
+
+static UINT64 g_tilesHits = 0;
+static UINT64 g_tilesMisses = 0;
+
+static inline UINT64 rdpHashRound(UINT64 acc, UINT64 input)
+{
+	acc += input * RDP_HASH_PRIME2;
+	acc = (acc << 31) | (acc >> 33);
+	return acc * RDP_HASH_PRIME1;
+}
+
+/**
+ * xxHash64 style hash over a rectangle of the framebuffer. The four
+ * independent lanes are processed in 32 byte stripes which lets the
+ * compiler keep them in vector registers.
+ */
+static UINT64 rdpTileHash(const char* data, int scanline, int lineBytes, int lines)
+{
+	UINT64 v1 = RDP_HASH_PRIME1 + RDP_HASH_PRIME2;
+	UINT64 v2 = RDP_HASH_PRIME2;
+	UINT64 v3 = 0;
+	UINT64 v4 = 0 - RDP_HASH_PRIME1;
+	UINT64 tail = RDP_HASH_PRIME3;
+	UINT64 in[4];
+	UINT64 h;
+	int x, y;
+
+	for (y = 0; y < lines; y++)
+	{
+		const char* p = data + (size_t) y * scanline;
+
+		for (x = 0; x + 32 <= lineBytes; x += 32)
+		{
+			memcpy(in, p + x, sizeof(in));
+			v1 = rdpHashRound(v1, in[0]);
+			v2 = rdpHashRound(v2, in[1]);
+			v3 = rdpHashRound(v3, in[2]);
+			v4 = rdpHashRound(v4, in[3]);
+		}
+
+		for (; x < lineBytes; x++)
+			tail = rdpHashRound(tail, (BYTE) p[x]);
+	}
+
+	h = ((v1 << 1) | (v1 >> 63)) + ((v2 << 7) | (v2 >> 57)) +
+		((v3 << 12) | (v3 >> 52)) + ((v4 << 18) | (v4 >> 46));
+	h = rdpHashRound(h, tail);
+
+	h ^= h >> 33;
+	h *= RDP_HASH_PRIME2;
+	h ^= h >> 29;
+	h *= RDP_HASH_PRIME3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+static BOOL rdpTilesResize(int width, int height)
+{
+	rdpTile* tiles;
+	int tilesX = (width + RDP_TILE_SIZE - 1) >> RDP_TILE_SHIFT;
+	int tilesY = (height + RDP_TILE_SIZE - 1) >> RDP_TILE_SHIFT;
+
+	if (tilesX * tilesY > g_tilesX * g_tilesY || !g_tiles)
+	{
+		tiles = (rdpTile*) realloc(g_tiles, tilesX * tilesY * sizeof(rdpTile));
+
+		if (!tiles)
+			return FALSE;
+
+		g_tiles = tiles;
+	}
+
+	g_tilesX = tilesX;
+	g_tilesY = tilesY;
+	g_tilesWidth = width;
+	g_tilesHeight = height;
+
+	rdpTilesInvalidate();
+
+	return TRUE;
+}
+
+/* forget all hashes, the next damage of each tile is reported again */
+void rdpTilesInvalidate(void)
+{
+	if (g_tiles)
+		memset(g_tiles, 0, g_tilesX * g_tilesY * sizeof(rdpTile));
+
+	g_tilesStamp = 0;
+}
+
+void rdpTilesUninit(void)
+{
+	free(g_tiles);
+	g_tiles = NULL;
+	g_tilesX = g_tilesY = 0;
+	g_tilesWidth = g_tilesHeight = 0;
+
+	free(g_tilesUnchanged);
+	g_tilesUnchanged = NULL;
+	g_tilesUnchangedSize = 0;
+}
+
+static BOOL rdpTilesAddUnchanged(int count, const BoxRec* box)
+{
+	if (count >= g_tilesUnchangedSize)
+	{
+		int size = g_tilesUnchangedSize ? g_tilesUnchangedSize * 2 : 64;
+		BoxPtr boxes = (BoxPtr) realloc(g_tilesUnchanged, size * sizeof(BoxRec));
+
+		if (!boxes)
+			return FALSE;
+
+		g_tilesUnchanged = boxes;
+		g_tilesUnchangedSize = size;
+	}
+
+	g_tilesUnchanged[count] = *box;
+
+	return TRUE;
+}
+
+/**
+ * Rehash all tiles touched by region and subtract the ones whose content
+ * did not change since the last call.
+ */
+void rdpTilesFilterRegion(RegionPtr region, const char* fb, int scanline,
+		int bytesPerPixel, int width, int height)
+{
+	RegionRec unchanged;
+	BoxPtr rects;
+	BoxRec tileBox;
+	rdpTile* tile;
+	UINT64 hash;
+	int i, numRects, tx, ty, tx1, ty1, tx2, ty2;
+	int numUnchanged = 0;
+
+	if (width != g_tilesWidth || height != g_tilesHeight || !g_tiles)
+	{
+		if (!rdpTilesResize(width, height))
+			return;
+	}
+
+	/* stamps tell which tiles were already handled during this call */
+	if (++g_tilesStamp == 0)
+	{
+		for (i = 0; i < g_tilesX * g_tilesY; i++)
+			g_tiles[i].stamp = 0;
+
+		g_tilesStamp = 1;
+	}
+
+	numRects = REGION_NUM_RECTS(region);
+	rects = REGION_RECTS(region);
+
+	for (i = 0; i < numRects; i++)
+	{
+		tx1 = rects[i].x1 >> RDP_TILE_SHIFT;
+		ty1 = rects[i].y1 >> RDP_TILE_SHIFT;
+		tx2 = (rects[i].x2 - 1) >> RDP_TILE_SHIFT;
+		ty2 = (rects[i].y2 - 1) >> RDP_TILE_SHIFT;
+
+		for (ty = ty1; ty <= ty2 && ty < g_tilesY; ty++)
+		{
+			for (tx = tx1; tx <= tx2 && tx < g_tilesX; tx++)
+			{
+				tile = &g_tiles[ty * g_tilesX + tx];
+
+				if (tile->stamp == g_tilesStamp)
+					continue;
+
+				tile->stamp = g_tilesStamp;
+
+				tileBox.x1 = tx << RDP_TILE_SHIFT;
+				tileBox.y1 = ty << RDP_TILE_SHIFT;
+				tileBox.x2 = min(tileBox.x1 + RDP_TILE_SIZE, width);
+				tileBox.y2 = min(tileBox.y1 + RDP_TILE_SIZE, height);
+
+				hash = rdpTileHash(fb + tileBox.y1 * scanline + tileBox.x1 * bytesPerPixel,
+						scanline, (tileBox.x2 - tileBox.x1) * bytesPerPixel,
+						tileBox.y2 - tileBox.y1);
+
+				if (tile->valid && tile->hash == hash)
+				{
+					g_tilesHits++;
+
+					if (rdpTilesAddUnchanged(numUnchanged, &tileBox))
+						numUnchanged++;
+
+					continue;
+				}
+
+				g_tilesMisses++;
+				tile->hash = hash;
+				tile->valid = TRUE;
+			}
+		}
+	}
+
+	if (numUnchanged < 1)
+		return;
+
+	RegionInitBoxes(&unchanged, g_tilesUnchanged, numUnchanged);
+	RegionSubtract(region, region, &unchanged);
+	RegionUninit(&unchanged);
+}
+
+void rdpTilesGetStats(UINT64* hits, UINT64* misses)
+{
+	*hits = g_tilesHits;
+	*misses = g_tilesMisses;
+}
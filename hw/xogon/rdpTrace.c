@@ -0,0 +1,104 @@
+/**
+ * ogon Remote Desktop Services
+ * X11 backend
+ *
+ * Copyright (C) 2013-2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * Damage trace recording
+ *
+ * Writes the damage of every frame (before rectangle merging) to a file
+ * so the frame path can be replayed and benchmarked offline with
+ * rdp-damage-replay.
+ */
+
+#include "rdp.h"
+#include "rdpTrace.h"
+
+#include <stdio.h>
+
+extern rdpScreenInfoRec g_rdpScreen;
+
+static FILE* g_traceFile = NULL;
+static int g_traceWidth = 0;
+static int g_traceHeight = 0;
+static int g_traceBytesPerPixel = 0;
+
+Bool rdpTraceOpen(const char* path)
+{
+	rdpTraceClose();
+
+	g_traceFile = fopen(path, "w");
+
+	if (!g_traceFile)
+	{
+		ErrorF("rdpTraceOpen: failed to open %s\n", path);
+		return FALSE;
+	}
+
+	g_traceWidth = g_traceHeight = g_traceBytesPerPixel = 0;
+
+	return TRUE;
+}
+
+void rdpTraceClose(void)
+{
+	if (!g_traceFile)
+		return;
+
+	fclose(g_traceFile);
+	g_traceFile = NULL;
+}
+
+void rdpTraceFrame(const BoxRec* boxes, int numBoxes, int maxRects)
+{
+	int i;
+
+	if (!g_traceFile)
+		return;
+
+	if (g_traceWidth != g_rdpScreen.width || g_traceHeight != g_rdpScreen.height ||
+			g_traceBytesPerPixel != g_rdpScreen.bytesPerPixel)
+	{
+		g_traceWidth = g_rdpScreen.width;
+		g_traceHeight = g_rdpScreen.height;
+		g_traceBytesPerPixel = g_rdpScreen.bytesPerPixel;
+
+		fprintf(g_traceFile, "%s %d %d %d %d\n", RDP_TRACE_MAGIC, RDP_TRACE_VERSION,
+				g_traceWidth, g_traceHeight, g_traceBytesPerPixel);
+	}
+
+	fprintf(g_traceFile, "F %llu %d %d\n", (unsigned long long) GetTimeInMicros(),
+			maxRects, numBoxes);
+
+	for (i = 0; i < numBoxes; i++)
+	{
+		fprintf(g_traceFile, "R %d %d %d %d\n", boxes[i].x1, boxes[i].y1,
+				boxes[i].x2, boxes[i].y2);
+	}
+
+	if (ferror(g_traceFile))
+	{
+		ErrorF("rdpTraceFrame: write failed, stopping the trace\n");
+		rdpTraceClose();
+	}
+}
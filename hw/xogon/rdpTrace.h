@@ -0,0 +1,45 @@
+/**
+ * ogon Remote Desktop Services
+ * X11 backend
+ *
+ * Copyright (C) 2013-2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef OGON_X11RDP_TRACE_H
+#define OGON_X11RDP_TRACE_H
+
+/**
+ * Damage trace format, one record per line:
+ *
+ *   xogon-damage-trace 1 <width> <height> <bytesPerPixel>
+ *   F <time in us> <max rects> <num rects>
+ *   R <x1> <y1> <x2> <y2>          (num rects times)
+ *
+ * A new header is written whenever the framebuffer geometry changes.
+ */
+#define RDP_TRACE_MAGIC		"xogon-damage-trace"
+#define RDP_TRACE_VERSION	1
+
+Bool rdpTraceOpen(const char* path);
+void rdpTraceClose(void);
+void rdpTraceFrame(const BoxRec* boxes, int numBoxes, int maxRects);
+
+#endif /* OGON_X11RDP_TRACE_H */
@@ -54,6 +54,16 @@
 #include "rdpScreen.h"
 #include "rdpUpdate.h"
 #include "rdpRandr.h"
+#include "rdpCopy.h"
+#include "rdpMerge.h"
+#include "rdpTiles.h"
+#include "rdpFrame.h"
+#include "rdpMove.h"
+#include "rdpStats.h"
+#include "rdpTrace.h"
+#include "rdpHelper.h"
+#include "rdpKeymap.h"
+#include "rdpStandby.h"
 
 #include <string.h>
 
@@ -77,15 +87,38 @@ BOOL g_rdsDamageSyncRequested = FALSE;
 
 static int g_button_mask = 0;
 
+static rdpCopyRect* g_copyRects = NULL;
+static int g_copyRectsSize = 0;
+
+#define RDP_DMGBUF_MAX	3
+
+/**
+ * Attached damage buffers. ogon may rotate between a few buffers so that
+ * it can encode one while the next frame is staged into another. pending
+ * holds the damage of frames that were delivered in other buffers since
+ * the buffer was last synced. g_rdsDamage is the buffer of the current
+ * sync request.
+ */
+typedef struct _rdpDamageBuffer
+{
+	void* dmgbuf;
+	RegionRec pending;
+	UINT32 lastUsed;
+} rdpDamageBuffer;
+
+static rdpDamageBuffer g_dmgbufs[RDP_DMGBUF_MAX];
+static UINT32 g_dmgbufSequence = 0;
+
 extern ScreenPtr g_pScreen;
 extern int g_Bpp;
 extern int g_Bpp_mask;
 extern rdpScreenInfoRec g_rdpScreen;
 extern int g_width_max;
 extern int g_height_max;
+extern int g_damageMergeWaste;
+extern int g_damageBuffers;
 extern DeviceIntPtr g_multitouch;
-
-static wArrayList* g_Messages = NULL;
+extern int g_multitouchFd;
 
 typedef struct winLayoutMapping
 {
@@ -114,12 +147,6 @@ winLayoutMapEntry layoutMap[] =
 	{0x00000419, "ru"}
 };
 
-int init_messages_list(void)
-{
-	g_Messages = ArrayList_New(FALSE);
-	return 0;
-}
-
 static const char *rds_get_keyboard_layout(unsigned int winKeyboardId)
 {
   int i;
@@ -131,33 +158,7 @@ static const char *rds_get_keyboard_layout(unsigned int winKeyboardId)
   return NULL;
 }
 
-static void system_background(char *cmd)
-{
-	pid_t pid = fork();
-	int status;
-	if (0 == pid)
-	{
-		/* child */
-		if (0 == fork())
-		{
-			int retCode = system(cmd);
-			if (retCode != 0)
-				fprintf(stderr, "x11rdp: error executing \"%s\"\n", cmd);
-			_exit(0);
-		}
-		else
-		{
-			_exit(0);
-		}
-	}
-	else
-	{
-		/* parent */
-		waitpid(pid, &status, 0);
-	}
-}
-
-
+static int rds_service_accept(ogon_backend_service *service);
 int rds_service_disconnect(ogon_backend_service *service);
 
 int rdp_send_message(UINT16 type, ogon_message *msg)
@@ -225,24 +226,66 @@ static int rdp_send_sync_framebuffer_reply(void)
 	return 0;
 }
 
-static int rdp_sync_damage_rect(int x, int y, int w, int h, char* dst, char* src)
+static int rdp_num_rds_framebuffers(void)
+{
+	int i, count = 0;
+
+	for (i = 0; i < RDP_DMGBUF_MAX; i++)
+	{
+		if (g_dmgbufs[i].dmgbuf)
+			count++;
+	}
+
+	return count;
+}
+
+static rdpDamageBuffer* rdp_current_rds_framebuffer(void)
+{
+	int i;
+
+	for (i = 0; i < RDP_DMGBUF_MAX; i++)
+	{
+		if (g_dmgbufs[i].dmgbuf && g_dmgbufs[i].dmgbuf == g_rdsDamage)
+			return &g_dmgbufs[i];
+	}
+
+	return NULL;
+}
+
+/* copy boxes from the framebuffer into the current damage buffer */
+static void rdp_copy_boxes(const BoxRec* boxes, int numBoxes)
 {
-	int i, wb, offset;
+	int i;
+	UINT64 bytes = 0;
 
-	wb = w * g_rdpScreen.bytesPerPixel;
+	if (numBoxes > g_copyRectsSize)
+	{
+		rdpCopyRect* copyRects = (rdpCopyRect*) realloc(g_copyRects, numBoxes * sizeof(rdpCopyRect));
 
-	offset = (y * g_rdpScreen.scanline) + (x * g_rdpScreen.bytesPerPixel);
+		if (!copyRects)
+		{
+			ErrorF("rdp_copy_boxes: failed to allocate copy rects\n");
+			return;
+		}
 
-	src += offset;
-	dst += offset;
+		g_copyRects = copyRects;
+		g_copyRectsSize = numBoxes;
+	}
 
-	for (i = 0; i < h; i++)
+	for (i = 0; i < numBoxes; i++)
 	{
-		memcpy(dst, src, wb);
-		src += g_rdpScreen.scanline;
-		dst += g_rdpScreen.scanline;
+		g_copyRects[i].x = boxes[i].x1;
+		g_copyRects[i].y = boxes[i].y1;
+		g_copyRects[i].width = boxes[i].x2 - boxes[i].x1;
+		g_copyRects[i].height = boxes[i].y2 - boxes[i].y1;
+		bytes += (UINT64) g_copyRects[i].width * g_copyRects[i].height * g_rdpScreen.bytesPerPixel;
 	}
-	return 0;
+
+	rdpCopyRects((char*) ogon_dmgbuf_get_data(g_rdsDamage), g_rdpScreen.pfbMemory,
+			g_rdpScreen.width, g_rdpScreen.scanline, g_rdpScreen.bytesPerPixel,
+			g_copyRects, numBoxes);
+
+	rdpStatsAdd(RDP_STATS_BYTES, bytes);
 }
 
 int rdp_handle_damage_region(int callerId)
@@ -252,8 +295,9 @@ int rdp_handle_damage_region(int callerId)
 	RDP_RECT* rdsDamageRects;
 	BoxRec singleRect;
 	int i, numRects;
-	char* src;
-	char *dst;
+	rdpDamageBuffer* current;
+	RegionRec frame;
+	CARD64 start;
 
 	LLOGLN(10, ("rdp_handle_damage_region: callerId=%d", callerId));
 
@@ -268,6 +312,15 @@ int rdp_handle_damage_region(int callerId)
 		return 0;
 	}
 
+	if (!g_rdpScreen.sendFullDamage && !RegionNotEmpty(DamageRegion(g_rdpScreen.x11Damage)))
+		return 0;
+
+	/* aggregate damage until the frame interval is over */
+	if (!rdpFrameReady())
+		return 0;
+
+	start = GetTimeInMicros();
+
 	if (g_rdpScreen.sendFullDamage)
 	{
 		singleRect.x1 = 0;
@@ -278,6 +331,14 @@ int rdp_handle_damage_region(int callerId)
 		numRects = 1;
 		rects = &singleRect;
 		g_rdpScreen.sendFullDamage = FALSE;
+
+		rdpTraceFrame(rects, numRects, ogon_dmgbuf_get_max_rects(g_rdsDamage));
+
+		if (g_rdpScreen.tileHash)
+			rdpTilesInvalidate();
+
+		if (g_rdpScreen.detectMoves)
+			rdpMoveReset();
 	}
 	else
 	{
@@ -287,68 +348,205 @@ int rdp_handle_damage_region(int callerId)
 		if (!RegionNotEmpty(region))
 			return 0;
 
-		numRects = REGION_NUM_RECTS(region);
-		rects = REGION_RECTS(region);
-
-		if (numRects > ogon_dmgbuf_get_max_rects(g_rdsDamage))
+		if (g_rdpScreen.tileHash)
 		{
-			/* FIXME: if required we could intelligently reduce the region to maxDamageRects instead */
-			rects = REGION_EXTENTS(g_pScreen, region);
-			numRects = 1;
+			rdpTilesFilterRegion(region, g_rdpScreen.pfbMemory, g_rdpScreen.scanline,
+					g_rdpScreen.bytesPerPixel, g_rdpScreen.width, g_rdpScreen.height);
+
+			/* everything was repainted with identical content */
+			if (!RegionNotEmpty(region))
+				return 0;
 		}
+
+		rdpTraceFrame(REGION_RECTS(region), REGION_NUM_RECTS(region),
+				ogon_dmgbuf_get_max_rects(g_rdsDamage));
+
+		numRects = rdpMergeBoxes(REGION_RECTS(region), REGION_NUM_RECTS(region),
+				ogon_dmgbuf_get_max_rects(g_rdsDamage), g_damageMergeWaste, &rects);
 	}
 
 	LLOGLN(10, ("rdp_handle_damage_region: numRects=%d", numRects));
 
 	ogon_dmgbuf_set_num_rects(g_rdsDamage, numRects);
 
-	dst = (char*)ogon_dmgbuf_get_data(g_rdsDamage);
-	src = (char*)g_rdpScreen.pfbMemory;
-
 	rdsDamageRects = ogon_dmgbuf_get_rects(g_rdsDamage, NULL);
 
 	for (i = 0; i < numRects; i++)
 	{
-		int x, y, w, h;
-		x = rdsDamageRects[i].x = rects[i].x1;
-		y = rdsDamageRects[i].y = rects[i].y1;
-		w = rdsDamageRects[i].width = rects[i].x2 - rects[i].x1;
-		h = rdsDamageRects[i].height = rects[i].y2 - rects[i].y1;
-		rdp_sync_damage_rect(x, y, w, h, dst, src);
+		rdsDamageRects[i].x = rects[i].x1;
+		rdsDamageRects[i].y = rects[i].y1;
+		rdsDamageRects[i].width = rects[i].x2 - rects[i].x1;
+		rdsDamageRects[i].height = rects[i].y2 - rects[i].y1;
+	}
+
+	if (rdp_num_rds_framebuffers() > 1)
+	{
+		/* the other buffers miss this frame, the current one older frames */
+		RegionInitBoxes(&frame, rects, numRects);
+		current = rdp_current_rds_framebuffer();
+
+		for (i = 0; i < RDP_DMGBUF_MAX; i++)
+		{
+			if (g_dmgbufs[i].dmgbuf)
+				RegionUnion(&g_dmgbufs[i].pending, &g_dmgbufs[i].pending, &frame);
+		}
+
+		RegionUninit(&frame);
+
+		rdp_copy_boxes(REGION_RECTS(&current->pending), REGION_NUM_RECTS(&current->pending));
+		RegionEmpty(&current->pending);
+	}
+	else if (!g_rdpScreen.fbShared)
+	{
+		/* in zero copy mode fb already rendered into the damage buffer */
+		rdp_copy_boxes(rects, numRects);
+	}
+
+	if (g_rdpScreen.detectMoves)
+	{
+		rdpMoveRec* moves;
+		UINT64 movedPixels = 0;
+		int numMoves = rdpMoveTake(&moves);
+
+		/**
+		 * The damage buffer has no move list yet, the moved areas are
+		 * still part of the damage rects. Count them so -statsinterval
+		 * shows how much a move list would save.
+		 */
+		for (i = 0; i < numMoves; i++)
+		{
+			movedPixels += (UINT64) (moves[i].dst.x2 - moves[i].dst.x1) *
+					(moves[i].dst.y2 - moves[i].dst.y1);
+		}
+
+		rdpStatsAdd(RDP_STATS_MOVES, numMoves);
+		rdpStatsAdd(RDP_STATS_MOVED_PIXELS, movedPixels);
+		LLOGLN(10, ("rdp_handle_damage_region: numMoves=%d", numMoves));
 	}
 
 	DamageEmpty(g_rdpScreen.x11Damage);
 
 	g_rdsDamageSyncRequested = FALSE;
 	rdp_send_sync_framebuffer_reply();
+	rdpFrameSent();
+
+	rdpStatsAdd(RDP_STATS_RECTS, numRects);
+	rdpStatsRecord(RDP_STATS_RECTS_PER_FRAME, numRects);
+	rdpStatsRecord(RDP_STATS_DAMAGE_TIME, GetTimeInMicros() - start);
+	rdpStatsFrameSent();
 
 	return 0;
 }
 
-void rdp_detach_rds_framebuffer(void)
+static void rdp_free_rds_framebuffer(rdpDamageBuffer* buffer)
 {
-	if (g_rdsDamage)
+	/* fb must not render into the damage buffer after it got unmapped */
+	if (g_rdpScreen.fbShared && g_rdpScreen.pfbMemory == ogon_dmgbuf_get_data(buffer->dmgbuf) &&
+			!rdpScreenUnshareFrameBuffer())
+	{
+		FatalError("rdp_free_rds_framebuffer: failed to restore private framebuffer\n");
+	}
+
+	if (buffer->dmgbuf == g_rdsDamage)
 	{
-		g_rdsDamageLastBufferId = ogon_dmgbuf_get_id(g_rdsDamage);
-		ogon_dmgbuf_free(g_rdsDamage);
 		g_rdsDamage = NULL;
 		g_rdsDamageSyncRequested = FALSE;
 	}
+
+	ogon_dmgbuf_free(buffer->dmgbuf);
+	buffer->dmgbuf = NULL;
+	RegionUninit(&buffer->pending);
+}
+
+void rdp_detach_rds_framebuffer(void)
+{
+	int i;
+
+	/* a sync request for it may still be queued, see the sync handlers */
+	if (g_rdsDamage)
+		g_rdsDamageLastBufferId = ogon_dmgbuf_get_id(g_rdsDamage);
+
+	for (i = 0; i < RDP_DMGBUF_MAX; i++)
+	{
+		if (g_dmgbufs[i].dmgbuf)
+			rdp_free_rds_framebuffer(&g_dmgbufs[i]);
+	}
+
+	g_rdsDamage = NULL;
+	g_rdsDamageSyncRequested = FALSE;
+}
+
+static rdpDamageBuffer* rdp_find_rds_framebuffer(UINT32 bufferId)
+{
+	int i;
+
+	for (i = 0; i < RDP_DMGBUF_MAX; i++)
+	{
+		if (g_dmgbufs[i].dmgbuf && ogon_dmgbuf_get_id(g_dmgbufs[i].dmgbuf) == bufferId)
+			return &g_dmgbufs[i];
+	}
+
+	return NULL;
 }
 
+/* a free slot, or the least recently used buffer which gets released */
+static rdpDamageBuffer* rdp_reserve_rds_framebuffer(void)
+{
+	rdpDamageBuffer* lru = NULL;
+	int i, count = 0;
+
+	for (i = 0; i < RDP_DMGBUF_MAX; i++)
+	{
+		if (!g_dmgbufs[i].dmgbuf)
+			continue;
+
+		count++;
+
+		if (!lru || g_dmgbufs[i].lastUsed < lru->lastUsed)
+			lru = &g_dmgbufs[i];
+	}
+
+	if (lru && count >= g_damageBuffers)
+		rdp_free_rds_framebuffer(lru);
+
+	for (i = 0; i < RDP_DMGBUF_MAX; i++)
+	{
+		if (!g_dmgbufs[i].dmgbuf)
+			return &g_dmgbufs[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * Make bufferId the current damage buffer. Buffers that are not attached
+ * yet are connected and filled with the screen content.
+ */
 void rdp_attach_rds_framebuffer(int bufferId)
 {
 	BoxRec screenBox;
 	RegionRec screenRegion;
 	RegionPtr damageRegion;
+	rdpDamageBuffer* buffer;
+	BOOL first;
 	char *dst = NULL;
 	char *src = NULL;
 	unsigned int size = 0;
 
-	if (g_rdsDamage)
-		rdp_detach_rds_framebuffer();
+	buffer = rdp_find_rds_framebuffer(bufferId);
+
+	if (buffer)
+	{
+		g_rdsDamage = buffer->dmgbuf;
+		buffer->lastUsed = ++g_dmgbufSequence;
+		return;
+	}
+
+	buffer = rdp_reserve_rds_framebuffer();
+	first = (rdp_num_rds_framebuffers() == 0);
 
 	g_rdsDamage = ogon_dmgbuf_connect(bufferId);
+	g_rdsDamageSyncRequested = FALSE;
 
 	if (g_rdsDamage && !g_rdpScreen.x11DamageRegistered)
 	{
@@ -356,16 +554,36 @@ void rdp_attach_rds_framebuffer(int bufferId)
 		g_rdpScreen.x11DamageRegistered = TRUE;
 	}
 
-	screenBox.x1 = 0;
-	screenBox.y1 = 0;
-	screenBox.x2 = g_rdpScreen.width;
-	screenBox.y2 = g_rdpScreen.height;
-	RegionInit(&screenRegion, &screenBox, 1);
-	damageRegion = DamageRegion(g_rdpScreen.x11Damage);
+	if (first)
+	{
+		screenBox.x1 = 0;
+		screenBox.y1 = 0;
+		screenBox.x2 = g_rdpScreen.width;
+		screenBox.y2 = g_rdpScreen.height;
+		RegionInit(&screenRegion, &screenBox, 1);
+		damageRegion = DamageRegion(g_rdpScreen.x11Damage);
+
+		RegionUnion(damageRegion, damageRegion, &screenRegion);
+
+		RegionUninit(&screenRegion);
+
+		/* a new damage buffer does not contain what the hashes describe */
+		if (g_rdpScreen.tileHash)
+			rdpTilesInvalidate();
+	}
 
-	RegionUnion(damageRegion, damageRegion, &screenRegion);
+	if (!g_rdsDamage)
+		return;
 
-	RegionUninit(&screenRegion);
+	buffer->dmgbuf = g_rdsDamage;
+	buffer->lastUsed = ++g_dmgbufSequence;
+	RegionNull(&buffer->pending);
+
+	/* zero copy only works with a single damage buffer */
+	if (!first && g_rdpScreen.fbShared && !rdpScreenUnshareFrameBuffer())
+	{
+		FatalError("rdp_attach_rds_framebuffer: failed to restore private framebuffer\n");
+	}
 
 	/* Initially fill the dmgbuffer with screen content. */
 	dst = (char*)ogon_dmgbuf_get_data(g_rdsDamage);
@@ -373,7 +591,11 @@ void rdp_attach_rds_framebuffer(int bufferId)
 	if (!dst || !src)
 		return;
 	size = ogon_dmgbuf_get_fbsize(g_rdsDamage);
-	memcpy(dst, src, size);
+
+	if (first && g_rdpScreen.zeroCopy && rdpScreenShareFrameBuffer(dst, size))
+		return;
+
+	memcpy(dst, src, MIN(size, g_rdpScreen.sizeInBytes));
 }
 
 static BOOL rds_client_framebuffer_sync_request(ogon_backend_service *backend, UINT32 bufferId)
@@ -387,14 +609,13 @@ static BOOL rds_client_framebuffer_sync_request(ogon_backend_service *backend, U
 
 	if (!g_rdsDamage || bufferId != ogon_dmgbuf_get_id(g_rdsDamage))
 	{
-		if (g_rdsDamage) {
-			rdp_detach_rds_framebuffer();
-		}
 		rdp_attach_rds_framebuffer(bufferId);
 	}
 
 	if (g_rdsDamage) {
 		g_rdsDamageSyncRequested = TRUE;
+		rdpFrameRequested();
+		rdpStatsSyncRequested();
 	}
 
 	rdp_handle_damage_region(1);
@@ -407,23 +628,24 @@ static BOOL rds_client_capabilities(ogon_backend_service *backend, ogon_msg_capa
 	int width;
 	int height;
 	const char *lang = rds_get_keyboard_layout(capabilities->keyboardLayout);
-	char cmd[32];
+	char* setxkbmap[3];
+
+	if (!lang)
+		lang = RDP_KEYMAP_LAYOUT;
 
 	width = capabilities->desktopWidth;
 	height = capabilities->desktopHeight;
 
 
-	/* First approach for setting the proper keyboard layout*/
-	if (NULL != lang)
+	/* fall back to setxkbmap if the keymap can't be compiled in the server */
+	if (!rdpKeymapSetLayout(lang))
 	{
-		snprintf(cmd, 32, "setxkbmap %s", lang);
-	}
-	else
-	{
-		snprintf(cmd, 32, "setxkbmap us");
-	}
+		setxkbmap[0] = "setxkbmap";
+		setxkbmap[1] = (char*) lang;
+		setxkbmap[2] = NULL;
 
-	system_background(cmd);
+		rdpHelperSpawn(setxkbmap, 0, FALSE);
+	}
 
 	if ((g_pScreen->width != width) || (g_pScreen->height != height))
 	{
@@ -461,7 +683,7 @@ static BOOL rds_client_capabilities(ogon_backend_service *backend, ogon_msg_capa
 
 	rdp_send_framebuffer_info();
 
-	rdpSpriteSetCursor(NULL, NULL, g_rdpScreen.pCurs, 0, 0);
+	rdpSpriteResendCursor();
 
 	return TRUE;
 }
@@ -474,6 +696,7 @@ static BOOL rds_client_synchronize_keyboard_event(ogon_backend_service* backend,
 
 static BOOL rds_client_scancode_keyboard_event(ogon_backend_service* backend, DWORD flags, DWORD code, DWORD keyboardType)
 {
+	rdpStatsInputEvent();
 	KbdAddScancodeEvent(flags, code, keyboardType);
 	return TRUE;
 }
@@ -481,12 +704,15 @@ static BOOL rds_client_scancode_keyboard_event(ogon_backend_service* backend, DW
 
 static BOOL rds_client_unicode_keyboard_event(ogon_backend_service* backend, DWORD flags, DWORD code)
 {
+	rdpStatsInputEvent();
 	KbdAddUnicodeEvent(flags, code);
 	return TRUE;
 }
 
 static BOOL rds_client_mouse_event(ogon_backend_service* backend, DWORD flags, DWORD x, DWORD y)
 {
+	rdpStatsInputEvent();
+
 	if (x > g_rdpScreen.width - 2)
 		x = g_rdpScreen.width - 2;
 
@@ -581,6 +807,8 @@ static BOOL rds_client_mouse_event(ogon_backend_service* backend, DWORD flags, D
 
 static BOOL rds_client_extended_mouse_event(ogon_backend_service* backend, DWORD flags, DWORD x, DWORD y)
 {
+	rdpStatsInputEvent();
+
 	if (x > g_rdpScreen.width - 2)
 		x = g_rdpScreen.width - 2;
 
@@ -624,6 +852,8 @@ static BOOL rds_client_extended_mouse_event(ogon_backend_service* backend, DWORD
 
 static BOOL rds_client_immediate_sync_request(void *backend, INT32 bufferId)
 {
+	rdpDamageBuffer* current;
+
 	/* ignore the old buffer id that might still be in the queue */
 	if (!g_rdsDamage && bufferId == g_rdsDamageLastBufferId)
 	{
@@ -633,39 +863,33 @@ static BOOL rds_client_immediate_sync_request(void *backend, INT32 bufferId)
 
 	if (!g_rdsDamage || bufferId != ogon_dmgbuf_get_id(g_rdsDamage))
 	{
-		if (g_rdsDamage) {
-			rdp_detach_rds_framebuffer();
-		}
 		rdp_attach_rds_framebuffer(bufferId);
 	}
 
-	ogon_dmgbuf_set_num_rects(g_rdsDamage, 0);
-	rdp_send_sync_framebuffer_reply();
-	return TRUE;
-}
+	if (!g_rdsDamage)
+		return TRUE;
 
-static void write_pipe_rds_client_message(int fd, BYTE* value, int size)
-{
-	int written;
-	int totalWritten = 0;
+	/* bring the buffer up to date with the frames it missed */
+	current = rdp_current_rds_framebuffer();
 
-	while (totalWritten != size) {
-		written = write(fd, value + totalWritten, size - totalWritten);
-		if (written < 0) {
-			fprintf(stderr, "%s: socket(%d) for message display closed unexpected\n", __FUNCTION__, fd);
-			close(fd);
-			exit(1);
-		}
-		totalWritten += written;
+	if (current && RegionNotEmpty(&current->pending))
+	{
+		rdp_copy_boxes(REGION_RECTS(&current->pending), REGION_NUM_RECTS(&current->pending));
+		RegionEmpty(&current->pending);
 	}
+
+	ogon_dmgbuf_set_num_rects(g_rdsDamage, 0);
+	rdp_send_sync_framebuffer_reply();
+	return TRUE;
 }
 
 #define BUFFER_SIZE_MESSAGE 1024 * 4
 
-static int display_message(ogon_msg_message* msg) {
-	int retVal = 0;
-	char buffer[BUFFER_SIZE_MESSAGE];
+static BOOL rds_client_message(ogon_backend_service* backend, ogon_msg_message* msg)
+{
 	char executableName[BUFFER_SIZE_MESSAGE];
+	char numbers[4][16];
+	char* argv[11];
 	struct stat sb;
 
 	//check if ogon-message is present in install dir.
@@ -676,77 +900,87 @@ static int display_message(ogon_msg_message* msg) {
 		snprintf(executableName, BUFFER_SIZE_MESSAGE, "ogon-message");
 	}
 
-	snprintf(buffer, BUFFER_SIZE_MESSAGE, "%s %u %u %u %u \"%s\" \"%s\" \"%s\" \"%s\" \"%s\"",
-			executableName,
-			msg->message_id, msg->message_type, msg->style, msg->timeout,
-			msg->parameter_num > 0 ? msg->parameter1 : "",
-			msg->parameter_num > 1 ? msg->parameter2 : "",
-			msg->parameter_num > 2 ? msg->parameter3 : "",
-			msg->parameter_num > 3 ? msg->parameter4 : "",
-			msg->parameter_num > 4 ? msg->parameter5 : ""
-			);
-
-	retVal = system(buffer);
-	if (!WIFEXITED(retVal))
+	snprintf(numbers[0], sizeof(numbers[0]), "%u", msg->message_id);
+	snprintf(numbers[1], sizeof(numbers[1]), "%u", msg->message_type);
+	snprintf(numbers[2], sizeof(numbers[2]), "%u", msg->style);
+	snprintf(numbers[3], sizeof(numbers[3]), "%u", msg->timeout);
+
+	argv[0] = executableName;
+	argv[1] = numbers[0];
+	argv[2] = numbers[1];
+	argv[3] = numbers[2];
+	argv[4] = numbers[3];
+	argv[5] = msg->parameter_num > 0 ? msg->parameter1 : "";
+	argv[6] = msg->parameter_num > 1 ? msg->parameter2 : "";
+	argv[7] = msg->parameter_num > 2 ? msg->parameter3 : "";
+	argv[8] = msg->parameter_num > 3 ? msg->parameter4 : "";
+	argv[9] = msg->parameter_num > 4 ? msg->parameter5 : "";
+	argv[10] = NULL;
+
+	if (!rdpHelperSpawn(argv, msg->message_id, TRUE))
 	{
-		return -1;
+		fprintf(stderr, "%s: unable to display message %u\n", __FUNCTION__, msg->message_id);
+		return FALSE;
 	}
-	retVal = WEXITSTATUS(retVal);
-	if (retVal == 255) {
-		retVal = -1;
+
+	return TRUE;
+}
+
+static void rds_multitouch_notify(int fd, int ready, void* data)
+{
+	if (multitouchHandle() < 0) {
+		RemoveNotifyFd(g_multitouchFd);
+		g_multitouchFd = -1;
+		multitouchClose();
 	}
-	return retVal;
 }
 
-static BOOL rds_client_message(ogon_backend_service* backend, ogon_msg_message* msg)
+static void rds_client_notify(int fd, int ready, void* data)
 {
-	pid_t pid;
-	int status;
-	int retVal = 0;
-	int fd[2];
-	int* save;
+	ogon_backend_service* service = (ogon_backend_service*) data;
+	ogon_incoming_bytes_result res;
+
+	res = ogon_service_incoming_bytes(service, service);
+	KbdFlushUnicodeEvents();
+	PtrFlushMotionEvents();
 
-	status = pipe(fd);
-	if (status != 0)
+	switch (res)
 	{
-		fprintf(stderr, "%s: pipe creation failed\n", __FUNCTION__);
-		return FALSE;
+	case OGON_INCOMING_BYTES_WANT_MORE_DATA:
+	case OGON_INCOMING_BYTES_OK:
+		break;
+
+	case OGON_INCOMING_BYTES_BROKEN_PIPE:
+	case OGON_INCOMING_BYTES_INVALID_MESSAGE:
+	default:
+		rds_service_disconnect(service);
+		break;
 	}
-	pid = fork();
-	if (0 == pid)
-	{
-		/* child */
-		if (0 == fork())
-		{
-			/* Child process closes up input side of pipe */
-			close(fd[0]);
-
-			retVal = display_message(msg);
+}
 
-			write_pipe_rds_client_message(fd[1], (BYTE *)&retVal, sizeof(retVal));
-			write_pipe_rds_client_message(fd[1], (BYTE *)&msg->message_id, sizeof(msg->message_id));
+static void rds_server_notify(int fd, int ready, void* data)
+{
+	ogon_backend_service* service = (ogon_backend_service*) data;
 
-			close(fd[1]);
-			_exit(0);
-		}
-		else
-		{
-			_exit(0);
-		}
-	}
-	else
-	{
-		/* parent */
-		waitpid(pid, &status, 0);
-		/* Parent process closes up output side of pipe */
-		close(fd[1]);
-		save = malloc(sizeof(int));
-		*save = fd[0];
-		ArrayList_Add(g_Messages,save);
-		AddEnabledDevice(fd[0]);
+	if (rds_service_accept(service) == 0) {
+		g_multitouchFd = multitouchTryToStart();
+		if (g_multitouchFd >= 0)
+			SetNotifyFd(g_multitouchFd, rds_multitouch_notify, X_NOTIFY_READ, NULL);
 	}
+}
 
-	return TRUE;
+static void rds_message_reply(UINT32 message_id, int result)
+{
+	ogon_msg_message_reply rep;
+
+	if (!g_connected)
+		return;
+
+	fprintf(stderr, "%s: sending message with messageid (%d) and result(%d)\n", __FUNCTION__,message_id,result);
+
+	rep.message_id = message_id;
+	rep.result = (UINT32)result;
+	rdp_send_message(OGON_SERVER_MESSAGE_REPLY, (ogon_message*) &rep);
 }
 
 static int rds_service_accept(ogon_backend_service* service)
@@ -760,28 +994,27 @@ static int rds_service_accept(ogon_backend_service* service)
 		return 1;
 	}
 
-	RemoveEnabledDevice(g_serverfd);
+	RemoveNotifyFd(g_serverfd);
 
 	g_clientfd = ogon_service_client_fd(service);
 	g_connected = 1;
 	rdp_send_version();
 
 
-	AddEnabledDevice(g_clientfd);
+	SetNotifyFd(g_clientfd, rds_client_notify, X_NOTIFY_READ, service);
 
 	fprintf(stderr, "RdsServiceAccept()\n");
 
 	return 0;
 }
 
-extern int g_multitouchFd;
 int rds_service_disconnect(ogon_backend_service* service)
 {
 	KbdSessionDisconnect();
 
-	RemoveEnabledDevice(g_clientfd);
+	RemoveNotifyFd(g_clientfd);
 	if (g_multitouchFd >= 0) {
-		RemoveEnabledDevice(g_multitouchFd);
+		RemoveNotifyFd(g_multitouchFd);
 		g_multitouchFd = -1;
 		multitouchClose();
 	}
@@ -790,13 +1023,22 @@ int rds_service_disconnect(ogon_backend_service* service)
 
 	fprintf(stderr, "RdsServiceDisconnect()\n");
 
+	if (g_rdpScreen.tileHash)
+	{
+		UINT64 hits, misses;
+
+		rdpTilesGetStats(&hits, &misses);
+		fprintf(stderr, "%s: tile hash hits: %llu misses: %llu\n", __FUNCTION__,
+				(unsigned long long) hits, (unsigned long long) misses);
+	}
+
 	g_active = 0;
 	g_connected = 0;
 	g_clientfd = -1;
 
 	rdp_detach_rds_framebuffer();
 
-	AddEnabledDevice(g_serverfd);
+	SetNotifyFd(g_serverfd, rds_server_notify, X_NOTIFY_READ, service);
 
 	return 0;
 }
@@ -856,114 +1098,9 @@ int rdp_init(void)
 		ogon_service_set_callbacks(g_service, &g_callbacks);
 
 		g_serverfd = ogon_service_server_fd(g_service);
-		AddEnabledDevice( g_serverfd );
+		SetNotifyFd(g_serverfd, rds_server_notify, X_NOTIFY_READ, g_service);
+		rdpHelperSetReplyHandler(rds_message_reply);
 	}
 
 	return 1;
 }
-
-static int read_pipe_rds_client_message(int fd, BYTE* buffer, int size)
-{
-	int currentRead;
-	int totalBytes = 0;
-	while (totalBytes != size) {
-		currentRead = read(fd, buffer + totalBytes, size - totalBytes);
-		if (currentRead < 1) {
-			fprintf(stderr, "%s: socket(%d) for message display closed unexpected\n", __FUNCTION__, fd);
-			close(fd);
-			return 0;
-		}
-		totalBytes += currentRead;
-	}
-	return 1;
-}
-
-static void check_message_fds(fd_set *fdset)
-{
-	int index = 0;
-	int messagefd;
-	int* save;
-	int result;
-	UINT32 message_id;
-	ogon_msg_message_reply rep;
-
-	save = ArrayList_GetItem(g_Messages, index++);
-	while (save)
-	{
-		messagefd = *save;
-		if (FD_ISSET(messagefd, fdset)) {
-
-			RemoveEnabledDevice(messagefd);
-			ArrayList_Remove(g_Messages,save);
-			free(save);
-			if (!g_connected) {
-				close(messagefd);
-				return;
-			}
-
-			if (!read_pipe_rds_client_message(messagefd, (BYTE *)&result, sizeof(result)))
-				return;
-			if (!read_pipe_rds_client_message(messagefd, (BYTE *)&message_id, sizeof(message_id)))
-				return;
-
-			close(messagefd);
-
-			fprintf(stderr, "%s: sending message with messageid (%d) and result(%d)\n", __FUNCTION__,message_id,result);
-
-			rep.message_id = message_id;
-			rep.result = (UINT32)result;
-			rdp_send_message(OGON_SERVER_MESSAGE_REPLY, (ogon_message*) &rep);
-			return;
-		}
-		save = ArrayList_GetItem(g_Messages, index++);
-	}
-	return;
-}
-
-void rdp_check(void *blockData, int result, void *bitset)
-{
-	ogon_backend_service* service = g_service;
-	ogon_incoming_bytes_result res;
-	fd_set *fdset = (fd_set *)bitset;
-
-	check_message_fds(fdset);
-
-	if (g_connected)
-	{
-		if (FD_ISSET(g_clientfd, fdset)) {
-			res = ogon_service_incoming_bytes(service, service);
-
-			switch (res)
-			{
-			case OGON_INCOMING_BYTES_WANT_MORE_DATA:
-			case OGON_INCOMING_BYTES_OK:
-				return;
-
-			case OGON_INCOMING_BYTES_BROKEN_PIPE:
-			case OGON_INCOMING_BYTES_INVALID_MESSAGE:
-			default:
-				rds_service_disconnect(service);
-				break;
-			}
-		}
-
-		if (g_multitouchFd >= 0 && FD_ISSET(g_multitouchFd, fdset)) {
-			if (multitouchHandle() < 0) {
-				RemoveEnabledDevice(g_multitouchFd);
-				g_multitouchFd = -1;
-				multitouchClose();
-			}
-		}
-	}
-	else
-	{
-		if (!FD_ISSET(g_serverfd, fdset))
-			return;
-
-		if (rds_service_accept(service) == 0) {
-			g_multitouchFd = multitouchTryToStart();
-			if (g_multitouchFd >= 0)
-				AddEnabledDevice(g_multitouchFd);
-		}
-	}
-}
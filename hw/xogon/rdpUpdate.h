@@ -41,8 +41,6 @@ int rdp_send_version(void);
 void rdp_detach_rds_framebuffer(void);
 void rdp_attach_rds_framebuffer(int bufferId);
 int rdp_init(void);
-void rdp_check(void *blockData, int result, void *bitset);
 int rdp_handle_damage_region(int callerId);
-int init_messages_list(void);
 
 #endif /* OGON_X11RDP_UPDATE_H */
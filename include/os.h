@@ -117,6 +117,16 @@ extern _X_EXPORT int WriteToClient(ClientPtr /*who */ , int /*count */ ,
 
 extern _X_EXPORT void ResetOsBuffers(void);
 
+typedef struct _OsInputStats {
+    unsigned long reads;        /* reads from client connections */
+    unsigned long bytes;        /* bytes read */
+    unsigned long requests;     /* requests read */
+    unsigned long resizes;      /* input buffers replaced by another size */
+} OsInputStatsRec, *OsInputStatsPtr;
+
+extern _X_EXPORT void GetInputStats(OsInputStatsPtr /*stats */ ,
+                                    Bool /*reset */ );
+
 extern _X_EXPORT void InitConnectionLimits(void);
 
 extern _X_EXPORT void NotifyParentProcess(void);
@@ -127,6 +137,8 @@ extern _X_EXPORT void ResetWellKnownSockets(void);
 
 extern _X_EXPORT void CloseWellKnownConnections(void);
 
+extern _X_EXPORT Bool ListenOnDisplay(void);
+
 extern _X_EXPORT XID AuthorizationIDOfClient(ClientPtr /*client */ );
 
 extern _X_EXPORT const char *ClientAuthorized(ClientPtr /*client */ ,
@@ -150,6 +162,16 @@ extern _X_EXPORT void AddEnabledDevice(int /*fd */ );
 
 extern _X_EXPORT void RemoveEnabledDevice(int /*fd */ );
 
+#define X_NOTIFY_READ   1
+#define X_NOTIFY_WRITE  2
+
+typedef void (*NotifyFdProcPtr)(int fd, int ready, void *data);
+
+extern _X_EXPORT Bool SetNotifyFd(int fd, NotifyFdProcPtr notify, int mask,
+                                  void *data);
+
+extern _X_EXPORT void RemoveNotifyFd(int fd);
+
 extern _X_EXPORT int OnlyListenToOneClient(ClientPtr /*client */ );
 
 extern _X_EXPORT void ListenToAllClients(void);
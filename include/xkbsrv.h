@@ -298,6 +298,7 @@ extern _X_EXPORT int XkbEventBase;
 extern _X_EXPORT int XkbKeyboardErrorCode;
 extern _X_EXPORT const char *XkbBaseDirectory;
 extern _X_EXPORT const char *XkbBinDirectory;
+extern _X_EXPORT const char *XkbKeymapOutputName;
 
 extern _X_EXPORT CARD32 xkbDebugFlags;
 
@@ -760,6 +761,9 @@ extern _X_EXPORT void XkbFreeRMLVOSet(XkbRMLVOSet * /* rmlvo */ ,
 extern _X_EXPORT void XkbSetRulesDflts(XkbRMLVOSet *    /* rmlvo */
     );
 
+extern _X_EXPORT void XkbSetRulesUsed(XkbRMLVOSet *    /* rmlvo */
+    );
+
 extern _X_EXPORT void XkbDeleteRulesDflts(void
     );
 
@@ -883,4 +887,9 @@ extern _X_EXPORT XkbDescPtr XkbCompileKeymapFromString(DeviceIntPtr dev,
 						       const char *keymap,
 						       int keymap_length);
 
+extern _X_EXPORT XkbDescPtr XkbCompileKeymapCached(DeviceIntPtr /* dev */ ,
+                                                   XkbRMLVOSet * /* rmlvo */ ,
+                                                   const char * /* cacheName */
+    );
+
 #endif                          /* _XKBSRV_H_ */
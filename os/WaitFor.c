@@ -221,13 +221,14 @@ WaitForSomething(int *pClientsReady)
             i = -1;
         else if (AnyClientsWriteBlocked) {
             XFD_COPYSET(&ClientsWriteBlocked, &clientsWritable);
-            i = Select(MaxClients, &LastSelectMask, &clientsWritable, NULL, wt);
+            i = PollWait(&LastSelectMask, &clientsWritable, wt);
         }
         else {
-            i = Select(MaxClients, &LastSelectMask, NULL, NULL, wt);
+            i = PollWait(&LastSelectMask, NULL, wt);
         }
         selecterr = GetErrno();
         WakeupHandler(i, (void *) &LastSelectMask);
+        PollNotify();
         if (i <= 0) {           /* An error or timeout occurred */
             if (dispatchException)
                 return 0;
@@ -130,6 +130,7 @@ fd_set ClientsWithInput;        /* clients with FULL requests in buffer */
 fd_set ClientsWriteBlocked;     /* clients who cannot receive output */
 fd_set OutputPending;           /* clients with reply/event data ready to go */
 int MaxClients = 0;
+int LimitClients = LIMITCLIENTS; /* highest number of client ids */
 Bool NewOutputPending;          /* not yet attempted to write some new output */
 Bool AnyClientsWriteBlocked;    /* true if some client blocked on write */
 Bool NoListenAll;               /* Don't establish any listening sockets */
@@ -296,10 +297,10 @@ InitConnectionLimits(void)
     if (lastfdesc > MAXSELECT)
         lastfdesc = MAXSELECT;
 
-    if (lastfdesc > MAXCLIENTS) {
-        lastfdesc = MAXCLIENTS;
+    if (lastfdesc > LimitClients) {
+        lastfdesc = LimitClients;
         if (debug_conns)
-            ErrorF("REACHED MAXIMUM CLIENTS LIMIT %d\n", MAXCLIENTS);
+            ErrorF("REACHED MAXIMUM CLIENTS LIMIT %d\n", LimitClients);
     }
     MaxClients = lastfdesc;
 
@@ -461,6 +462,52 @@ CreateWellKnownSockets(void)
 #endif
 }
 
+/*****************
+ * ListenOnDisplay
+ *    Take the lock file and create the listening sockets for the current
+ *    display later on. This is for servers started with NoListenAll which
+ *    get their display number assigned while running. Returns FALSE if
+ *    the sockets could not be created, the server is unchanged then.
+ *****************/
+
+Bool
+ListenOnDisplay(void)
+{
+    int i;
+    int partial;
+
+    if (!NoListenAll || ListenTransCount)
+        return FALSE;
+
+    NoListenAll = FALSE;
+    LockServer();
+
+    if (!TryCreateSocket(atoi(display), &partial) || ListenTransCount < 1 ||
+        (!PartialNetwork && partial)) {
+        CloseWellKnownConnections();
+        UnlockServer();
+        NoListenAll = TRUE;
+        return FALSE;
+    }
+
+    free(ListenTransFds);
+    ListenTransFds = xnfalloc(ListenTransCount * sizeof (int));
+
+    for (i = 0; i < ListenTransCount; i++) {
+        int fd = _XSERVTransGetConnectionNumber(ListenTransConns[i]);
+
+        ListenTransFds[i] = fd;
+        FD_SET(fd, &WellKnownConnections);
+        FD_SET(fd, &AllSockets);
+
+        if (!_XSERVTransIsLocal(ListenTransConns[i]))
+            DefineSelf (fd);
+    }
+
+    ResetHosts(display);
+    return TRUE;
+}
+
 void
 ResetWellKnownSockets(void)
 {
@@ -478,6 +525,7 @@ ResetWellKnownSockets(void)
                  * Remove it from out list.
                  */
 
+                PollForgetFd(ListenTransFds[i]);
                 FD_CLR(ListenTransFds[i], &WellKnownConnections);
                 ListenTransFds[i] = ListenTransFds[ListenTransCount - 1];
                 ListenTransConns[i] = ListenTransConns[ListenTransCount - 1];
@@ -491,6 +539,7 @@ ResetWellKnownSockets(void)
 
                 int newfd = _XSERVTransGetConnectionNumber(ListenTransConns[i]);
 
+                PollForgetFd(ListenTransFds[i]);
                 FD_CLR(ListenTransFds[i], &WellKnownConnections);
                 ListenTransFds[i] = newfd;
                 FD_SET(newfd, &WellKnownConnections);
@@ -515,6 +564,7 @@ CloseWellKnownConnections(void)
 
     for (i = 0; i < ListenTransCount; i++) {
         if (ListenTransConns[i] != NULL) {
+            PollForgetFd(_XSERVTransGetConnectionNumber(ListenTransConns[i]));
             _XSERVTransClose(ListenTransConns[i]);
             ListenTransConns[i] = NULL;
         }
@@ -765,6 +815,8 @@ AllocNewConnection(XtransConnInfo trans_conn, int fd, CARD32 conn_time)
     oc->fd = fd;
     oc->input = (ConnectionInputPtr) NULL;
     oc->output = (ConnectionOutputPtr) NULL;
+    oc->input_avg = 0;
+    oc->input_batch = 0;
     oc->auth_id = None;
     oc->conn_time = conn_time;
     if (!(client = NextAvailableClient((void *) oc))) {
@@ -947,6 +999,7 @@ CloseDownFileDescriptor(OsCommPtr oc)
 {
     int connection = oc->fd;
 
+    PollForgetFd(connection);
     if (oc->trans_conn) {
         _XSERVTransDisconnect(oc->trans_conn);
         _XSERVTransClose(oc->trans_conn);
@@ -1076,6 +1129,7 @@ AddEnabledDevice(int fd)
 void
 RemoveGeneralSocket(int fd)
 {
+    PollForgetFd(fd);
     FD_CLR(fd, &AllSockets);
     if (GrabInProgress)
         FD_CLR(fd, &SavedAllSockets);
@@ -92,15 +92,24 @@ typedef struct _connectionInput {
     unsigned int ignoreBytes;   /* bytes to ignore before the next request */
 } ConnectionInput;
 
+/*
+ * Output of a client is queued as a list of buffers. Small writes are
+ * coalesced into the last buffer, larger ones get a buffer of their own,
+ * so queued output is copied once and never moved or grown afterwards.
+ */
 typedef struct _connectionOutput {
-    struct _connectionOutput *next;
+    struct _connectionOutput *next;     /* next buffer in the queue */
+    struct _connectionOutput *last;     /* end of the queue, in the first */
     unsigned char *buf;
     int size;
-    int count;
+    int count;                  /* bytes in buf */
+    int start;                  /* bytes of buf already written */
 } ConnectionOutput;
 
-static ConnectionInputPtr AllocateInputBuffer(void);
-static ConnectionOutputPtr AllocateOutputBuffer(void);
+static ConnectionInputPtr AllocateInputBuffer(int size);
+static void FreeInputBuffer(ConnectionInputPtr oci);
+static ConnectionOutputPtr AllocateOutputBuffer(int size);
+static void FreeOutputBuffer(ConnectionOutputPtr oco);
 
 /* If EAGAIN and EWOULDBLOCK are distinct errno values, then we check errno
  * for both EAGAIN and EWOULDBLOCK, because some supposedly POSIX
@@ -116,10 +125,25 @@ static ConnectionOutputPtr AllocateOutputBuffer(void);
 #define ETEST(err) (err == EAGAIN || err == WSAEWOULDBLOCK)
 #endif
 
+#define BUFSIZE 4096
+#define BUFWATERMARK 8192
+
+/*
+ * Input buffers come in a few size classes, 4k, 16k, 64k and 256k, which
+ * are recycled through a free list each. Larger ones are freed after use.
+ */
+#define INPUT_CLASSES 4
+#define INPUT_CLASS_SIZE(c) (BUFSIZE << (2 * (c)))
+#define MAX_FREE_INPUTS 8
+#define INPUT_BATCH_MAX (64 * 1024)     /* most to read ahead at once */
+
 static Bool CriticalOutputPending;
 static int timesThisConnection = 0;
-static ConnectionInputPtr FreeInputs = (ConnectionInputPtr) NULL;
+static ConnectionInputPtr FreeInputs[INPUT_CLASSES];
+static int NumFreeInputs[INPUT_CLASSES];
+static OsInputStatsRec InputStats;
 static ConnectionOutputPtr FreeOutputs = (ConnectionOutputPtr) NULL;
+static int NumFreeOutputs = 0;
 static OsCommPtr AvailableInput = (OsCommPtr) NULL;
 
 #define get_req_len(req,cli) ((cli)->swapped ? \
@@ -132,8 +156,14 @@ static OsCommPtr AvailableInput = (OsCommPtr) NULL;
 				  ((xBigReq *)(req))->length)
 
 #define MAX_TIMES_PER         10
-#define BUFSIZE 4096
-#define BUFWATERMARK 8192
+#define MAX_FREE_OUTPUTS 64
+
+/* queued buffers handed to a single writev */
+#if defined(IOV_MAX) && IOV_MAX < 66
+#define OUTPUT_IOV (IOV_MAX - 2)
+#else
+#define OUTPUT_IOV 64
+#endif
 
 /*
  *   A lot of the code in this file manipulates a ConnectionInputPtr:
@@ -221,22 +251,62 @@ NextAvailableInput(OsCommPtr oc)
 {
     if (AvailableInput) {
         if (AvailableInput != oc) {
-            ConnectionInputPtr aci = AvailableInput->input;
-
-            if (aci->size > BUFWATERMARK) {
-                free(aci->buffer);
-                free(aci);
-            }
-            else {
-                aci->next = FreeInputs;
-                FreeInputs = aci;
-            }
+            FreeInputBuffer(AvailableInput->input);
             AvailableInput->input = NULL;
         }
         AvailableInput = NULL;
     }
 }
 
+/* Size of the buffer to use for size bytes of input */
+static int
+InputBufferSize(unsigned int size)
+{
+    int c;
+
+    for (c = 0; c < INPUT_CLASSES; c++)
+        if (size <= INPUT_CLASS_SIZE(c))
+            return INPUT_CLASS_SIZE(c);
+    return (size + BUFSIZE - 1) & ~(BUFSIZE - 1);
+}
+
+/*
+ * Input a client should have room for between requests: its average
+ * request, and the amount of pipelined input its recent reads brought in.
+ */
+static unsigned int
+InputBufferWant(OsCommPtr oc)
+{
+    return max(oc->input_avg, oc->input_batch);
+}
+
+/*
+ * Replace the buffer of oci by one of size bytes, keeping the count bytes
+ * of unprocessed input at bufptr.
+ */
+static Bool
+ResizeInputBuffer(ConnectionInputPtr oci, int size, int count)
+{
+    ConnectionInputPtr tmp;
+    char *buffer;
+
+    if (!(tmp = AllocateInputBuffer(size)))
+        return FALSE;
+    if (count > 0)
+        memcpy(tmp->buffer, oci->bufptr, count);
+    buffer = oci->buffer;
+    size = oci->size;
+    oci->buffer = tmp->buffer;
+    oci->size = tmp->size;
+    oci->bufptr = oci->buffer;
+    oci->bufcnt = count;
+    tmp->buffer = buffer;
+    tmp->size = size;
+    FreeInputBuffer(tmp);
+    InputStats.resizes++;
+    return TRUE;
+}
+
 int
 ReadRequestFromClient(ClientPtr client)
 {
@@ -246,6 +316,8 @@ ReadRequestFromClient(ClientPtr client)
     unsigned int gotnow, needed;
     int result;
     register xReq *request;
+    unsigned int want;
+    int space;
     Bool need_header;
     Bool move_header;
 
@@ -254,10 +326,7 @@ ReadRequestFromClient(ClientPtr client)
     /* make sure we have an input buffer */
 
     if (!oci) {
-        if ((oci = FreeInputs)) {
-            FreeInputs = oci->next;
-        }
-        else if (!(oci = AllocateInputBuffer())) {
+        if (!(oci = AllocateInputBuffer(InputBufferWant(oc)))) {
             YieldControlDeath();
             return -1;
         }
@@ -334,23 +403,29 @@ ReadRequestFromClient(ClientPtr client)
         if ((gotnow == 0) || ((oci->bufptr - oci->buffer + needed) > oci->size)) {
             /* no data, or the request is too big to fit in the buffer */
 
-            if ((gotnow > 0) && (oci->bufptr != oci->buffer))
-                /* save the data we've already read */
-                memmove(oci->buffer, oci->bufptr, gotnow);
-            if (needed > oci->size) {
-                /* make buffer bigger to accomodate request */
-                char *ibuf;
-
-                ibuf = (char *) realloc(oci->buffer, needed);
-                if (!ibuf) {
+            want = max(needed, InputBufferWant(oc));
+            if (needed > oci->size ||
+                (gotnow == 0 && !oci->ignoreBytes &&
+                 (InputBufferSize(want) > oci->size ||
+                  InputBufferSize(4 * want) < oci->size))) {
+                /* make buffer bigger to accomodate request, or while it
+                 * is empty, move to the size this client needs. It is
+                 * only shrunk once it is four times too big, so clients
+                 * mixing large and small requests keep their buffer.
+                 * While skipping an oversized request needed is tied to
+                 * the current size, so the buffer is left alone. */
+                if (!ResizeInputBuffer(oci, InputBufferSize(want), gotnow)) {
                     YieldControlDeath();
                     return -1;
                 }
-                oci->size = needed;
-                oci->buffer = ibuf;
             }
-            oci->bufptr = oci->buffer;
-            oci->bufcnt = gotnow;
+            else {
+                if ((gotnow > 0) && (oci->bufptr != oci->buffer))
+                    /* save the data we've already read */
+                    memmove(oci->buffer, oci->bufptr, gotnow);
+                oci->bufptr = oci->buffer;
+                oci->bufcnt = gotnow;
+            }
         }
         /*  XXX this is a workaround.  This function is sometimes called
          *  after the trans_conn has been freed.  In this case trans_conn
@@ -364,8 +439,10 @@ ReadRequestFromClient(ClientPtr client)
             YieldControlDeath();
             return -1;
         }
+        space = oci->size - oci->bufcnt;
         result = _XSERVTransRead(oc->trans_conn, oci->buffer + oci->bufcnt,
-                                 oci->size - oci->bufcnt);
+                                 space);
+        InputStats.reads++;
         if (result <= 0) {
             if ((result < 0) && ETEST(errno)) {
 #if defined(SVR4) && defined(__i386__) && !defined(sun)
@@ -381,18 +458,14 @@ ReadRequestFromClient(ClientPtr client)
         }
         oci->bufcnt += result;
         gotnow += result;
-        /* free up some space after huge requests */
-        if ((oci->size > BUFWATERMARK) &&
-            (oci->bufcnt < BUFSIZE) && (needed < BUFSIZE)) {
-            char *ibuf;
-
-            ibuf = (char *) realloc(oci->buffer, BUFSIZE);
-            if (ibuf) {
-                oci->size = BUFSIZE;
-                oci->buffer = ibuf;
-                oci->bufptr = ibuf + oci->bufcnt - gotnow;
-            }
-        }
+        InputStats.bytes += result;
+        /* read further ahead while reads fill the buffer, less again
+         * once they come back mostly empty */
+        if (result == space)
+            oc->input_batch = min(max(oc->input_batch, BUFSIZE) * 2,
+                                  INPUT_BATCH_MAX);
+        else if (result < oc->input_batch / 4)
+            oc->input_batch /= 2;
         if (need_header && gotnow >= needed) {
             /* We wanted an xReq, now we've gotten it. */
             request = (xReq *) oci->bufptr;
@@ -440,6 +513,11 @@ ReadRequestFromClient(ClientPtr client)
         }
         needed = 0;
     }
+    else {
+        /* moving average of the request size, weighing the last by 1/8 */
+        oc->input_avg += ((int) needed - oc->input_avg) / 8;
+        InputStats.requests++;
+    }
 
     oci->lenLastReq = needed;
 
@@ -540,9 +618,7 @@ InsertFakeRequest(ClientPtr client, char *data, int count)
     NextAvailableInput(oc);
 
     if (!oci) {
-        if ((oci = FreeInputs))
-            FreeInputs = oci->next;
-        else if (!(oci = AllocateInputBuffer()))
+        if (!(oci = AllocateInputBuffer(InputBufferWant(oc))))
             return FALSE;
         oc->input = oci;
     }
@@ -550,14 +626,8 @@ InsertFakeRequest(ClientPtr client, char *data, int count)
     oci->lenLastReq = 0;
     gotnow = oci->bufcnt + oci->buffer - oci->bufptr;
     if ((gotnow + count) > oci->size) {
-        char *ibuf;
-
-        ibuf = (char *) realloc(oci->buffer, gotnow + count);
-        if (!ibuf)
+        if (!ResizeInputBuffer(oci, InputBufferSize(gotnow + count), gotnow))
             return FALSE;
-        oci->size = gotnow + count;
-        oci->buffer = ibuf;
-        oci->bufptr = ibuf + oci->bufcnt - gotnow;
     }
     moveup = count - (oci->bufptr - oci->buffer);
     if (moveup > 0) {
@@ -743,7 +813,6 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
     if (!count || !who || who == serverClient || who->clientGone)
         return 0;
     oc = who->osPrivate;
-    oco = oc->output;
 #ifdef DEBUG_COMMUNICATION
     {
         char info[128];
@@ -785,22 +854,6 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
     }
 #endif
 
-    if (!oco) {
-        if ((oco = FreeOutputs)) {
-            FreeOutputs = oco->next;
-        }
-        else if (!(oco = AllocateOutputBuffer())) {
-            if (oc->trans_conn) {
-                _XSERVTransDisconnect(oc->trans_conn);
-                _XSERVTransClose(oc->trans_conn);
-                oc->trans_conn = NULL;
-            }
-            MarkClientException(who);
-            return -1;
-        }
-        oc->output = oco;
-    }
-
     padBytes = padding_for_int32(count);
 
     if (ReplyCallback) {
@@ -843,7 +896,8 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
         }
     }
 #endif
-    if (oco->count == 0 || oco->count + count + padBytes > oco->size) {
+    oco = oc->output;
+    if (!oco || count + padBytes > oco->last->size - oco->last->count) {
         FD_CLR(oc->fd, &OutputPending);
         if (!XFD_ANYSET(&OutputPending)) {
             CriticalOutputPending = FALSE;
@@ -858,6 +912,7 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
 
     NewOutputPending = TRUE;
     FD_SET(oc->fd, &OutputPending);
+    oco = oco->last;
     memmove((char *) oco->buf + oco->count, buf, count);
     oco->count += count;
     if (padBytes) {
@@ -867,140 +922,170 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
     return count;
 }
 
+/*****************
+ * QueueOutput
+ *    Appends count bytes of data and pad zero bytes to the output queue
+ *    of the client, coalescing them into the last buffer if they fit.
+ *****************/
+
+static Bool
+QueueOutput(OsCommPtr oc, const char *data, int count, int pad)
+{
+    ConnectionOutputPtr oco = oc->output;
+    ConnectionOutputPtr last = oco ? oco->last : NULL;
+
+    if (count > INT_MAX - pad)
+        return FALSE;
+
+    if (!last || count + pad > last->size - last->count) {
+        if (!(last = AllocateOutputBuffer(count + pad)))
+            return FALSE;
+        if (oco) {
+            oco->last->next = last;
+            oco->last = last;
+        }
+        else
+            oc->output = last;
+    }
+
+    memcpy(last->buf + last->count, data, count);
+    last->count += count;
+    if (pad) {
+        memset(last->buf + last->count, '\0', pad);
+        last->count += pad;
+    }
+    return TRUE;
+}
+
+/* Drops the queued output of a client */
+static void
+DiscardOutput(OsCommPtr oc)
+{
+    ConnectionOutputPtr oco;
+
+    while ((oco = oc->output)) {
+        oc->output = oco->next;
+        FreeOutputBuffer(oco);
+    }
+}
+
  /********************
  * FlushClient()
- *    If the client isn't keeping up with us, then we try to continue
- *    buffering the data and set the apropriate bit in ClientsWritable
- *    (which is used by WaitFor in the select).  If the connection yields
- *    a permanent error, or we can't allocate any more space, we then
- *    close the connection.
+ *    Writes the queued output of the client followed by extraBuf with a
+ *    single writev, so large replies are not copied when the client keeps
+ *    up.  If the client isn't keeping up with us, then we queue the rest
+ *    of extraBuf and set the apropriate bit in ClientsWritable (which is
+ *    used by WaitFor in the select).  If the connection yields a
+ *    permanent error, or we can't allocate any more space, we then close
+ *    the connection.
  *
  **********************/
 
 int
 FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
 {
-    ConnectionOutputPtr oco = oc->output;
+    ConnectionOutputPtr oco;
     int connection = oc->fd;
     XtransConnInfo trans_conn = oc->trans_conn;
-    struct iovec iov[3];
+    struct iovec iov[OUTPUT_IOV + 2];
     static char padBuffer[3];
     const char *extraBuf = __extraBuf;
-    long written;
+    long extraWritten = 0;      /* of extraBuf and its padding */
+    long padWritten;
     long padsize;
-    long notWritten;
-    long todo;
+    long todo = LONG_MAX;       /* most to try at once */
+    long len;
 
-    if (!oco)
-	return 0;
-    written = 0;
     padsize = padding_for_int32(extraCount);
-    notWritten = oco->count + extraCount + padsize;
-    if (!notWritten)
+    if (!oc->output && !extraCount)
         return 0;
 
-    todo = notWritten;
-    while (notWritten) {
-        long before = written;  /* amount of whole thing written */
-        long remain = todo;     /* amount to try this time, <= notWritten */
+    for (;;) {
+        long remain = todo;
+        long tried;
         int i = 0;
-        long len;
-
-        /* You could be very general here and have "in" and "out" iovecs
-         * and write a loop without using a macro, but what the heck.  This
-         * translates to:
-         *
-         *     how much of this piece is new?
-         *     if more new then we are trying this time, clamp
-         *     if nothing new
-         *         then bump down amount already written, for next piece
-         *         else put new stuff in iovec, will need all of next piece
-         *
-         * Note that todo had better be at least 1 or else we'll end up
-         * writing 0 iovecs.
-         */
-#define InsertIOV(pointer, length) \
-	len = (length) - before; \
-	if (len > remain) \
-	    len = remain; \
-	if (len <= 0) { \
-	    before = (-len); \
-	} else { \
-	    iov[i].iov_len = len; \
-	    iov[i].iov_base = (pointer) + before;	\
-	    i++; \
-	    remain -= len; \
-	    before = 0; \
-	}
-
-        InsertIOV((char *) oco->buf, oco->count)
-            InsertIOV((char *) extraBuf, extraCount)
-            InsertIOV(padBuffer, padsize)
-
-            errno = 0;
+
+        /* the queued output first, then extraBuf and its padding */
+        for (oco = oc->output; oco && i < OUTPUT_IOV && remain > 0;
+             oco = oco->next) {
+            len = min(oco->count - oco->start, remain);
+            if (len > 0) {
+                iov[i].iov_base = (char *) oco->buf + oco->start;
+                iov[i].iov_len = len;
+                i++;
+                remain -= len;
+            }
+        }
+        padWritten = max(extraWritten - extraCount, 0);
+        if (!oco) {
+            len = min(extraCount - extraWritten, remain);
+            if (len > 0) {
+                iov[i].iov_base = (char *) extraBuf + extraWritten;
+                iov[i].iov_len = len;
+                i++;
+                remain -= len;
+            }
+            len = min(padsize - padWritten, remain);
+            if (len > 0) {
+                iov[i].iov_base = padBuffer + padWritten;
+                iov[i].iov_len = len;
+                i++;
+                remain -= len;
+            }
+        }
+        if (i == 0)
+            break;
+        tried = todo - remain;
+
+        errno = 0;
         if (trans_conn && (len = _XSERVTransWritev(trans_conn, iov, i)) >= 0) {
-            written += len;
-            notWritten -= len;
-            todo = notWritten;
+            /* release the buffers that are out, the rest was extraBuf */
+            while ((oco = oc->output) && len >= oco->count - oco->start) {
+                len -= oco->count - oco->start;
+                oc->output = oco->next;
+                if (oco->next)
+                    oco->next->last = oco->last;
+                FreeOutputBuffer(oco);
+            }
+            if (oco) {
+                oco->start += len;
+                len = 0;
+            }
+            extraWritten += len;
+            todo = LONG_MAX;
         }
         else if (ETEST(errno)
 #ifdef SUNSYSV                  /* check for another brain-damaged OS bug */
                  || (errno == 0)
 #endif
 #ifdef EMSGSIZE                 /* check for another brain-damaged OS bug */
-                 || ((errno == EMSGSIZE) && (todo == 1))
+                 || ((errno == EMSGSIZE) && (tried == 1))
 #endif
             ) {
             /* If we've arrived here, then the client is stuffed to the gills
-               and not ready to accept more.  Make a note of it and buffer
-               the rest. */
+               and not ready to accept more.  Make a note of it and queue
+               the rest of extraBuf, which is the only copy made of it. */
             FD_SET(connection, &ClientsWriteBlocked);
             AnyClientsWriteBlocked = TRUE;
 
-            if (written < oco->count) {
-                if (written > 0) {
-                    oco->count -= written;
-                    memmove((char *) oco->buf,
-                            (char *) oco->buf + written, oco->count);
-                    written = 0;
-                }
-            }
-            else {
-                written -= oco->count;
-                oco->count = 0;
-            }
-
-            if (notWritten > oco->size) {
-                unsigned char *obuf = NULL;
-
-                if (notWritten + BUFSIZE <= INT_MAX) {
-                    obuf = realloc(oco->buf, notWritten + BUFSIZE);
-                }
-                if (!obuf) {
-                    _XSERVTransDisconnect(oc->trans_conn);
-                    _XSERVTransClose(oc->trans_conn);
-                    oc->trans_conn = NULL;
-                    MarkClientException(who);
-                    oco->count = 0;
-                    return -1;
-                }
-                oco->size = notWritten + BUFSIZE;
-                oco->buf = obuf;
+            if (extraWritten < extraCount + padsize &&
+                !QueueOutput(oc, extraBuf + min(extraWritten, extraCount),
+                             max(extraCount - extraWritten, 0),
+                             padsize - padWritten)) {
+                _XSERVTransDisconnect(oc->trans_conn);
+                _XSERVTransClose(oc->trans_conn);
+                oc->trans_conn = NULL;
+                MarkClientException(who);
+                DiscardOutput(oc);
+                return -1;
             }
 
-            /* If the amount written extended into the padBuffer, then the
-               difference "extraCount - written" may be less than 0 */
-            if ((len = extraCount - written) > 0)
-                memmove((char *) oco->buf + oco->count,
-                        extraBuf + written, len);
-
-            oco->count = notWritten;    /* this will include the pad */
             /* return only the amount explicitly requested */
             return extraCount;
         }
 #ifdef EMSGSIZE                 /* check for another brain-damaged OS bug */
         else if (errno == EMSGSIZE) {
-            todo >>= 1;
+            todo = tried >> 1;
         }
 #endif
         else {
@@ -1010,45 +1095,49 @@ FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
                 oc->trans_conn = NULL;
             }
             MarkClientException(who);
-            oco->count = 0;
+            DiscardOutput(oc);
             return -1;
         }
     }
 
     /* everything was flushed out */
-    oco->count = 0;
+    DiscardOutput(oc);
     /* check to see if this client was write blocked */
     if (AnyClientsWriteBlocked) {
         FD_CLR(oc->fd, &ClientsWriteBlocked);
         if (!XFD_ANYSET(&ClientsWriteBlocked))
             AnyClientsWriteBlocked = FALSE;
     }
-    if (oco->size > BUFWATERMARK) {
-        free(oco->buf);
-        free(oco);
-    }
-    else {
-        oco->next = FreeOutputs;
-        FreeOutputs = oco;
-    }
-    oc->output = (ConnectionOutputPtr) NULL;
     return extraCount;          /* return only the amount explicitly requested */
 }
 
 static ConnectionInputPtr
-AllocateInputBuffer(void)
+AllocateInputBuffer(int size)
 {
     ConnectionInputPtr oci;
+    int c;
 
-    oci = malloc(sizeof(ConnectionInput));
-    if (!oci)
-        return NULL;
-    oci->buffer = malloc(BUFSIZE);
-    if (!oci->buffer) {
-        free(oci);
-        return NULL;
+    size = InputBufferSize(size);
+    for (c = 0; c < INPUT_CLASSES; c++)
+        if (size == INPUT_CLASS_SIZE(c))
+            break;
+
+    if (c < INPUT_CLASSES && (oci = FreeInputs[c])) {
+        FreeInputs[c] = oci->next;
+        NumFreeInputs[c]--;
+    }
+    else {
+        oci = malloc(sizeof(ConnectionInput));
+        if (!oci)
+            return NULL;
+        oci->buffer = malloc(size);
+        if (!oci->buffer) {
+            free(oci);
+            return NULL;
+        }
+        oci->size = size;
     }
-    oci->size = BUFSIZE;
+    oci->next = (ConnectionInputPtr) NULL;
     oci->bufptr = oci->buffer;
     oci->bufcnt = 0;
     oci->lenLastReq = 0;
@@ -1056,57 +1145,96 @@ AllocateInputBuffer(void)
     return oci;
 }
 
+static void
+FreeInputBuffer(ConnectionInputPtr oci)
+{
+    int c;
+
+    for (c = 0; c < INPUT_CLASSES; c++)
+        if (oci->size == INPUT_CLASS_SIZE(c))
+            break;
+
+    if (c == INPUT_CLASSES || NumFreeInputs[c] >= MAX_FREE_INPUTS) {
+        free(oci->buffer);
+        free(oci);
+    }
+    else {
+        oci->next = FreeInputs[c];
+        FreeInputs[c] = oci;
+        NumFreeInputs[c]++;
+    }
+}
+
 static ConnectionOutputPtr
-AllocateOutputBuffer(void)
+AllocateOutputBuffer(int size)
 {
     ConnectionOutputPtr oco;
 
-    oco = malloc(sizeof(ConnectionOutput));
-    if (!oco)
-        return NULL;
-    oco->buf = calloc(1, BUFSIZE);
-    if (!oco->buf) {
-        free(oco);
-        return NULL;
+    if (size <= BUFSIZE && (oco = FreeOutputs)) {
+        FreeOutputs = oco->next;
+        NumFreeOutputs--;
     }
-    oco->size = BUFSIZE;
+    else {
+        if (size < BUFSIZE)
+            size = BUFSIZE;
+        oco = malloc(sizeof(ConnectionOutput));
+        if (!oco)
+            return NULL;
+        oco->buf = malloc(size);
+        if (!oco->buf) {
+            free(oco);
+            return NULL;
+        }
+        oco->size = size;
+    }
+    oco->next = (ConnectionOutputPtr) NULL;
+    oco->last = oco;
     oco->count = 0;
+    oco->start = 0;
     return oco;
 }
 
+static void
+FreeOutputBuffer(ConnectionOutputPtr oco)
+{
+    if (oco->size > BUFWATERMARK || NumFreeOutputs >= MAX_FREE_OUTPUTS) {
+        free(oco->buf);
+        free(oco);
+    }
+    else {
+        oco->next = FreeOutputs;
+        FreeOutputs = oco;
+        NumFreeOutputs++;
+    }
+}
+
 void
 FreeOsBuffers(OsCommPtr oc)
 {
     ConnectionInputPtr oci;
-    ConnectionOutputPtr oco;
 
     if (AvailableInput == oc)
         AvailableInput = (OsCommPtr) NULL;
     if ((oci = oc->input)) {
-        if (FreeInputs) {
-            free(oci->buffer);
-            free(oci);
-        }
-        else {
-            FreeInputs = oci;
-            oci->next = (ConnectionInputPtr) NULL;
-            oci->bufptr = oci->buffer;
-            oci->bufcnt = 0;
-            oci->lenLastReq = 0;
-            oci->ignoreBytes = 0;
-        }
-    }
-    if ((oco = oc->output)) {
-        if (FreeOutputs) {
-            free(oco->buf);
-            free(oco);
-        }
-        else {
-            FreeOutputs = oco;
-            oco->next = (ConnectionOutputPtr) NULL;
-            oco->count = 0;
-        }
+        FreeInputBuffer(oci);
+        oc->input = (ConnectionInputPtr) NULL;
     }
+    DiscardOutput(oc);
+}
+
+/*****************
+ * GetInputStats
+ *    Copies the counters of ReadRequestFromClient into stats, and clears
+ *    them if reset is set.
+ *****************/
+
+void
+GetInputStats(OsInputStatsPtr stats, Bool reset)
+{
+    if (stats)
+        *stats = InputStats;
+    if (reset)
+        memset(&InputStats, 0, sizeof(InputStats));
 }
 
 void
@@ -1114,15 +1242,20 @@ ResetOsBuffers(void)
 {
     ConnectionInputPtr oci;
     ConnectionOutputPtr oco;
+    int c;
 
-    while ((oci = FreeInputs)) {
-        FreeInputs = oci->next;
-        free(oci->buffer);
-        free(oci);
+    for (c = 0; c < INPUT_CLASSES; c++) {
+        while ((oci = FreeInputs[c])) {
+            FreeInputs[c] = oci->next;
+            free(oci->buffer);
+            free(oci);
+        }
+        NumFreeInputs[c] = 0;
     }
     while ((oco = FreeOutputs)) {
         FreeOutputs = oco->next;
         free(oco->buf);
         free(oco);
     }
+    NumFreeOutputs = 0;
 }
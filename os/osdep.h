@@ -145,6 +145,8 @@ typedef struct _osComm {
     int fd;
     ConnectionInputPtr input;
     ConnectionOutputPtr output;
+    int input_avg;              /* average request size */
+    int input_batch;            /* bytes to read ahead */
     XID auth_id;                /* authorization id */
     CARD32 conn_time;           /* timestamp if not established, else 0  */
     struct _XtransConnInfo *trans_conn; /* transport connection object */
@@ -191,6 +193,11 @@ typedef long int fd_mask;
 #define ffs mffs
 extern int mffs(fd_mask);
 
+/* in ospoll.c */
+extern int PollWait(fd_set *readmask, fd_set *writemask, struct timeval *wt);
+extern void PollNotify(void);
+extern void PollForgetFd(int fd);
+
 /* in access.c */
 extern Bool ComputeLocalClient(ClientPtr client);
 
@@ -0,0 +1,411 @@
+/*
+ * Copyright © 2018 Thincast Technologies GmbH
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * The wait primitive behind WaitForSomething.
+ *
+ * With epoll the kernel keeps the interest set, so waiting no longer costs
+ * time proportional to the highest fd. The set is brought in line with
+ * AllSockets and the write blocked clients before every wait by comparing
+ * them word by word with what was registered last time; only fds that
+ * changed cost a system call. The result is handed back as fd_sets so the
+ * block and wakeup handlers keep working unchanged.
+ *
+ * Fds registered with SetNotifyFd are not part of AllSockets. Their
+ * callback is run directly for the fds that are ready, so a driver does not
+ * need to look through the select mask in its wakeup handler.
+ *
+ * Without epoll the same interface is implemented on top of select.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#ifdef WIN32
+#include <X11/Xwinsock.h>
+#endif
+#include <X11/Xos.h>
+#include <X11/Xpoll.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "misc.h"
+#include "osdep.h"
+#include "opaque.h"
+#include <list.h>
+
+#ifdef HAVE_EPOLL_CREATE1
+#include <sys/epoll.h>
+
+#define POLL_MAX_EVENTS     256
+
+/* marks the epoll data of notify fds */
+#define POLL_NOTIFY_TAG     ((uint64_t) 1 << 32)
+#endif
+
+struct notify_fd {
+    struct xorg_list    list;
+    int                 fd;
+    int                 mask;
+    int                 ready;
+    NotifyFdProcPtr     notify;
+    void                *data;
+};
+
+static struct xorg_list notify_fds;
+static Bool notify_init;
+
+#ifdef HAVE_EPOLL_CREATE1
+static int poll_fd = -1;
+static fd_set polled_read;
+static fd_set polled_write;
+static struct epoll_event poll_events[POLL_MAX_EVENTS];
+#else
+static fd_set notify_read;
+static fd_set notify_write;
+#endif
+
+static struct notify_fd *
+FindNotifyFd(int fd)
+{
+    struct notify_fd *n;
+
+    if (!notify_init)
+        return NULL;
+
+    xorg_list_for_each_entry(n, &notify_fds, list) {
+        if (n->fd == fd)
+            return n;
+    }
+    return NULL;
+}
+
+#ifdef HAVE_EPOLL_CREATE1
+
+static void
+PollInit(void)
+{
+    if (poll_fd >= 0)
+        return;
+
+    poll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (poll_fd < 0)
+        FatalError("PollInit: epoll_create1 failed: %s\n", strerror(errno));
+
+    FD_ZERO(&polled_read);
+    FD_ZERO(&polled_write);
+}
+
+static void
+PollControl(int fd, uint64_t data, uint32_t old, uint32_t new)
+{
+    struct epoll_event ev;
+    int op;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = new;
+    ev.data.u64 = data;
+
+    if (!old)
+        op = EPOLL_CTL_ADD;
+    else if (!new)
+        op = EPOLL_CTL_DEL;
+    else
+        op = EPOLL_CTL_MOD;
+
+    if (epoll_ctl(poll_fd, op, fd, &ev) == 0)
+        return;
+
+    /* the fd was closed and reopened, or is still there from before */
+    if (op == EPOLL_CTL_ADD && errno == EEXIST)
+        epoll_ctl(poll_fd, EPOLL_CTL_MOD, fd, &ev);
+    else if (op == EPOLL_CTL_MOD && errno == ENOENT)
+        epoll_ctl(poll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/*
+ * Bring the epoll set in line with AllSockets and the write interest.
+ * Errors are not retried, an fd which can't be added has been closed
+ * already and is about to be removed from AllSockets.
+ */
+static void
+PollSync(fd_set *write_interest)
+{
+    int i, fd;
+    unsigned long changed;
+    uint32_t old, new;
+
+    for (i = 0; i < howmany(FD_SETSIZE, NFDBITS); i++) {
+        fd_mask read_bits = __XFDS_BITS(&AllSockets, i);
+        fd_mask write_bits = write_interest ?
+            __XFDS_BITS(write_interest, i) : 0;
+
+        changed = (unsigned long) ((read_bits ^ __XFDS_BITS(&polled_read, i)) |
+                                   (write_bits ^ __XFDS_BITS(&polled_write, i)));
+
+        for (fd = i * NFDBITS; changed; fd++, changed >>= 1) {
+            if (!(changed & 1))
+                continue;
+
+            old = (FD_ISSET(fd, &polled_read) ? EPOLLIN : 0) |
+                  (FD_ISSET(fd, &polled_write) ? EPOLLOUT : 0);
+            new = (FD_ISSET(fd, &AllSockets) ? EPOLLIN : 0) |
+                  (write_interest && FD_ISSET(fd, write_interest) ? EPOLLOUT : 0);
+
+            PollControl(fd, (uint64_t) fd, old, new);
+        }
+
+        __XFDS_BITS(&polled_read, i) = read_bits;
+        __XFDS_BITS(&polled_write, i) = write_bits;
+    }
+}
+
+#endif
+
+/*
+ * Wait like select(2) on readmask and writemask with timeout wt (NULL to
+ * block). On return the masks contain the ready fds out of those passed in,
+ * writemask may be NULL. Notify fds which became ready are remembered for
+ * PollNotify. Returns the number of ready fds, 0 on timeout and -1 with
+ * errno set on error.
+ */
+int
+PollWait(fd_set *readmask, fd_set *writemask, struct timeval *wt)
+{
+#ifdef HAVE_EPOLL_CREATE1
+    fd_set read_filter, write_filter;
+    struct notify_fd *n;
+    int timeout = -1;
+    int ready = 0;
+    int i, nevents, fd;
+    uint32_t events;
+
+    PollInit();
+
+    if (wt)
+        timeout = wt->tv_sec * 1000 + (wt->tv_usec + 999) / 1000;
+
+    PollSync(writemask);
+
+    nevents = epoll_wait(poll_fd, poll_events, POLL_MAX_EVENTS, timeout);
+    if (nevents < 0)
+        return -1;
+
+    XFD_COPYSET(readmask, &read_filter);
+    FD_ZERO(readmask);
+    if (writemask) {
+        XFD_COPYSET(writemask, &write_filter);
+        FD_ZERO(writemask);
+    }
+
+    for (i = 0; i < nevents; i++) {
+        events = poll_events[i].events;
+        fd = (int) (poll_events[i].data.u64 & 0xffffffff);
+
+        if (poll_events[i].data.u64 & POLL_NOTIFY_TAG) {
+            if ((n = FindNotifyFd(fd))) {
+                if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                    n->ready |= n->mask & X_NOTIFY_READ;
+                if (events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+                    n->ready |= n->mask & X_NOTIFY_WRITE;
+                ready++;
+            }
+            continue;
+        }
+
+        if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) &&
+            FD_ISSET(fd, &read_filter)) {
+            FD_SET(fd, readmask);
+            ready++;
+        }
+        if (writemask && (events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) &&
+            FD_ISSET(fd, &write_filter)) {
+            FD_SET(fd, writemask);
+            ready++;
+        }
+    }
+
+    return ready;
+#else
+    fd_set writable;
+    struct notify_fd *n;
+    int i;
+
+    if (!writemask) {
+        FD_ZERO(&writable);
+        writemask = &writable;
+    }
+
+    XFD_ORSET(readmask, readmask, &notify_read);
+    XFD_ORSET(writemask, writemask, &notify_write);
+
+    i = Select(MaxClients, readmask, writemask, NULL, wt);
+
+    if (i > 0 && notify_init) {
+        xorg_list_for_each_entry(n, &notify_fds, list) {
+            if (FD_ISSET(n->fd, readmask))
+                n->ready |= X_NOTIFY_READ;
+            if (FD_ISSET(n->fd, writemask))
+                n->ready |= X_NOTIFY_WRITE;
+            FD_CLR(n->fd, readmask);
+            FD_CLR(n->fd, writemask);
+        }
+    }
+
+    return i;
+#endif
+}
+
+/*
+ * Run the callbacks of the notify fds found ready by the last PollWait. A
+ * callback may add or remove notify fds, so the list is walked again after
+ * each one.
+ */
+void
+PollNotify(void)
+{
+    struct notify_fd *n;
+    int ready;
+
+    if (!notify_init)
+        return;
+
+again:
+    xorg_list_for_each_entry(n, &notify_fds, list) {
+        if (n->ready) {
+            ready = n->ready;
+            n->ready = 0;
+            n->notify(n->fd, ready, n->data);
+            goto again;
+        }
+    }
+}
+
+/*
+ * Called before a socket which may be in AllSockets is closed, so a new fd
+ * with the same number is registered again.
+ */
+void
+PollForgetFd(int fd)
+{
+#ifdef HAVE_EPOLL_CREATE1
+    struct epoll_event ev;
+
+    if (poll_fd < 0 || fd < 0 || fd >= FD_SETSIZE)
+        return;
+
+    if (FD_ISSET(fd, &polled_read) || FD_ISSET(fd, &polled_write))
+        epoll_ctl(poll_fd, EPOLL_CTL_DEL, fd, &ev);
+
+    FD_CLR(fd, &polled_read);
+    FD_CLR(fd, &polled_write);
+#endif
+}
+
+/*
+ * Have notify called with the fd and X_NOTIFY_READ and/or X_NOTIFY_WRITE
+ * from WaitForSomething whenever the fd is ready for what mask asks for.
+ * The fd must not be in AllSockets as well. Calling this again for the
+ * same fd replaces the registration.
+ */
+Bool
+SetNotifyFd(int fd, NotifyFdProcPtr notify, int mask, void *data)
+{
+    struct notify_fd *n;
+#ifdef HAVE_EPOLL_CREATE1
+    uint32_t old = 0, new;
+#endif
+
+    if (fd < 0 || !notify)
+        return FALSE;
+
+    if (!mask) {
+        RemoveNotifyFd(fd);
+        return TRUE;
+    }
+
+#ifndef HAVE_EPOLL_CREATE1
+    if (fd >= FD_SETSIZE)
+        return FALSE;
+#endif
+
+    if (!notify_init) {
+        xorg_list_init(&notify_fds);
+        notify_init = TRUE;
+    }
+
+    n = FindNotifyFd(fd);
+    if (!n) {
+        n = calloc(1, sizeof(struct notify_fd));
+        if (!n)
+            return FALSE;
+        n->fd = fd;
+        xorg_list_add(&n->list, &notify_fds);
+    }
+#ifdef HAVE_EPOLL_CREATE1
+    else {
+        old = ((n->mask & X_NOTIFY_READ) ? EPOLLIN : 0) |
+              ((n->mask & X_NOTIFY_WRITE) ? EPOLLOUT : 0);
+    }
+
+    PollInit();
+    new = ((mask & X_NOTIFY_READ) ? EPOLLIN : 0) |
+          ((mask & X_NOTIFY_WRITE) ? EPOLLOUT : 0);
+    PollControl(fd, POLL_NOTIFY_TAG | (uint64_t) fd, old, new);
+#else
+    FD_CLR(fd, &notify_read);
+    FD_CLR(fd, &notify_write);
+    if (mask & X_NOTIFY_READ)
+        FD_SET(fd, &notify_read);
+    if (mask & X_NOTIFY_WRITE)
+        FD_SET(fd, &notify_write);
+#endif
+
+    n->mask = mask;
+    n->ready &= mask;
+    n->notify = notify;
+    n->data = data;
+    return TRUE;
+}
+
+void
+RemoveNotifyFd(int fd)
+{
+    struct notify_fd *n = FindNotifyFd(fd);
+#ifdef HAVE_EPOLL_CREATE1
+    struct epoll_event ev;
+#endif
+
+    if (!n)
+        return;
+
+#ifdef HAVE_EPOLL_CREATE1
+    epoll_ctl(poll_fd, EPOLL_CTL_DEL, fd, &ev);
+#else
+    FD_CLR(fd, &notify_read);
+    FD_CLR(fd, &notify_write);
+#endif
+
+    xorg_list_del(&n->list);
+    free(n);
+}
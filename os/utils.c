@@ -553,6 +553,7 @@ UseMsg(void)
 #ifdef RLIMIT_STACK
     ErrorF("-ls int                limit stack space to N Kb\n");
 #endif
+    ErrorF("-maxclients n          set maximum number of clients (power of two)\n");
 #ifdef LOCK_SERVER
     ErrorF("-nolock                disable the locking mechanism\n");
 #endif
@@ -567,6 +568,7 @@ UseMsg(void)
     ErrorF("-r                     turns off auto-repeat\n");
     ErrorF("r                      turns on auto-repeat \n");
     ErrorF("-render [default|mono|gray|color] set render color alloc policy\n");
+    ErrorF("-reqprofile            profile request dispatch, SIGUSR2 dumps\n");
     ErrorF("-retro                 start with classic stipple and cursor\n");
     ErrorF("-s #                   screen-saver timeout (minutes)\n");
     ErrorF("-seat string           seat to run on\n");
@@ -853,6 +855,18 @@ ProcessCommandLine(int argc, char *argv[])
                 UseMsg();
         }
 #endif
+        else if (strcmp(argv[i], "-maxclients") == 0) {
+            if (++i < argc) {
+                LimitClients = atoi(argv[i]);
+                if (LimitClients < 64 || LimitClients > MAXCLIENTS ||
+                    (LimitClients & (LimitClients - 1)) != 0) {
+                    FatalError("maxclients must be a power of two "
+                               "between 64 and %d\n", MAXCLIENTS);
+                }
+            }
+            else
+                UseMsg();
+        }
 #ifdef LOCK_SERVER
         else if (strcmp(argv[i], "-nolock") == 0) {
 #if !defined(WIN32) && !defined(__CYGWIN__)
@@ -906,6 +920,8 @@ ProcessCommandLine(int argc, char *argv[])
             defaultKeyboardControl.autoRepeat = TRUE;
         else if (strcmp(argv[i], "-r") == 0)
             defaultKeyboardControl.autoRepeat = FALSE;
+        else if (strcmp(argv[i], "-reqprofile") == 0)
+            RequestProfiling = TRUE;
         else if (strcmp(argv[i], "-retro") == 0)
             party_like_its_1989 = TRUE;
         else if (strcmp(argv[i], "-s") == 0) {
@@ -2135,9 +2151,9 @@ os_move_fd(int fd)
     int newfd;
 
 #ifdef F_DUPFD_CLOEXEC
-    newfd = fcntl(fd, F_DUPFD_CLOEXEC, MAXCLIENTS);
+    newfd = fcntl(fd, F_DUPFD_CLOEXEC, LimitClients);
 #else
-    newfd = fcntl(fd, F_DUPFD, MAXCLIENTS);
+    newfd = fcntl(fd, F_DUPFD, LimitClients);
 #endif
     if (newfd < 0)
         return fd;
@@ -68,6 +68,8 @@ typedef struct _AnimScrPriv {
     RealizeCursorProcPtr RealizeCursor;
     UnrealizeCursorProcPtr UnrealizeCursor;
     RecolorCursorProcPtr RecolorCursor;
+
+    Bool paused;                /* frames are not switched, see AnimCurSetPaused */
 } AnimCurScreenRec, *AnimCurScreenPtr;
 
 static unsigned char empty[4];
@@ -152,6 +154,9 @@ AnimCurScreenBlockHandler(ScreenPtr pScreen,
                 activeDevice = TRUE;
             }
 
+            if (as->paused)
+                continue;
+
             if ((INT32) (now - dev->spriteInfo->anim.time) >= 0) {
                 AnimCurPtr ac = GetAnimCur(dev->spriteInfo->anim.pCursor);
                 int elt = (dev->spriteInfo->anim.elt + 1) % ac->nelt;
@@ -179,7 +184,7 @@ AnimCurScreenBlockHandler(ScreenPtr pScreen,
         }
     }
 
-    if (activeDevice)
+    if (activeDevice && !as->paused)
         AdjustWaitForDelay(pTimeout, soonest - now);
 
     (*pScreen->BlockHandler) (pScreen, pTimeout, pReadmask);
@@ -319,6 +324,7 @@ AnimCurInit(ScreenPtr pScreen)
     Wrap(as, pScreen, CloseScreen, AnimCurCloseScreen);
 
     as->BlockHandler = NULL;
+    as->paused = FALSE;
 
     Wrap(as, pScreen, CursorLimits, AnimCurCursorLimits);
     Wrap(as, pScreen, DisplayCursor, AnimCurDisplayCursor);
@@ -330,6 +336,35 @@ AnimCurInit(ScreenPtr pScreen)
     return TRUE;
 }
 
+/*
+ * Stop switching the frames of animated cursors on pScreen, e.g. while
+ * nobody can see the cursor.  A paused animation keeps its current frame
+ * and does not wake up the server; on resume the next frame is shown at
+ * the next block handler.
+ */
+void
+AnimCurSetPaused(ScreenPtr pScreen, Bool paused)
+{
+    AnimCurScreenPtr as;
+    DeviceIntPtr dev;
+
+    if (!dixPrivateKeyRegistered(AnimCurScreenPrivateKey))
+        return;
+
+    as = GetAnimCurScreen(pScreen);
+    if (!as || as->paused == paused)
+        return;
+
+    as->paused = paused;
+    if (paused)
+        return;
+
+    for (dev = inputInfo.devices; dev; dev = dev->next) {
+        if (IsPointerDevice(dev) && pScreen == dev->spriteInfo->anim.pScreen)
+            dev->spriteInfo->anim.time = GetTimeInMillis();
+    }
+}
+
 int
 AnimCursorCreate(CursorPtr *cursors, CARD32 *deltas, int ncursor,
                  CursorPtr *ppCursor, ClientPtr client, XID cid)
@@ -546,6 +546,9 @@ CompositeTriFan(CARD8 op,
 Bool
  AnimCurInit(ScreenPtr pScreen);
 
+extern _X_EXPORT void
+ AnimCurSetPaused(ScreenPtr pScreen, Bool paused);
+
 int
 
 AnimCursorCreate(CursorPtr *cursors, CARD32 *deltas, int ncursor,
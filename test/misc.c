@@ -30,6 +30,8 @@
 #include "scrnintstr.h"
 #include "dix.h"
 #include "dixstruct.h"
+#include "opaque.h"
+#include "resource.h"
 
 ScreenInfo screenInfo;
 
@@ -190,6 +192,21 @@ dix_request_size_checks(void)
     assert(rc == Success);
 }
 
+static void
+dix_resource_client_bits(void)
+{
+    /* the split is fixed on first use, like after -maxclients 1024 */
+    LimitClients = 1024;
+    assert(RESOURCE_CLIENT_BITS == 10);
+    assert(CLIENTOFFSET == 19);
+    assert(RESOURCE_ID_MASK == 0x7ffff);
+    assert(CLIENT_ID(((Mask) 1023 << CLIENTOFFSET) | RESOURCE_ID_MASK) == 1023);
+
+    LimitClients = 256;
+    assert(RESOURCE_CLIENT_BITS == 10);
+    LimitClients = 1024;
+}
+
 
 int
 main(int argc, char **argv)
@@ -197,6 +214,7 @@ main(int argc, char **argv)
     dix_version_compare();
     dix_update_desktop_dimensions();
     dix_request_size_checks();
+    dix_resource_client_bits();
 
     return 0;
 }
@@ -26,7 +26,21 @@
 #endif
 
 #include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#define XSERV_t
+#define TRANS_SERVER
+#define TRANS_REOPEN
+#include <X11/Xtrans/Xtrans.h>
+#include <X11/Xproto.h>
+#include <X11/extensions/bigreqsproto.h>
 #include "os.h"
+#include "osdep.h"
+#include "opaque.h"
+#include "dixstruct.h"
 
 static int last_signal = 0;
 static int expect_signal = 0;
@@ -157,10 +171,93 @@ static void block_sigio_test_nested(void)
 #endif
 }
 
+/* write as much of data as the socket takes, returns the bytes written */
+static int
+write_some(int fd, const char *data, int len)
+{
+    int n = write(fd, data, len);
+
+    if (n < 0) {
+        assert(errno == EAGAIN);
+        return 0;
+    }
+    return n;
+}
+
+static void read_request_oversized_test(void)
+{
+    /* a Big Request far larger than the limit, followed by GetInputFocus */
+    const int limit = 1024, words = 256 * 1024;
+    long oldMaxBigRequestSize = maxBigRequestSize;
+    ClientRec client;
+    OsCommRec oc;
+    XtransConnInfo ciptr;
+    xBigReq *big;
+    xReq *next;
+    char *data;
+    int fds[2];
+    int len, sent = 0, result, oversized = 0;
+
+    len = words * 4 + sizeof(xReq);
+    data = calloc(1, len);
+    assert(data);
+    big = (xBigReq *) data;
+    big->reqType = X_PolyPoint;
+    big->zero = 0;
+    big->length = words;
+    next = (xReq *) (data + words * 4);
+    next->reqType = X_GetInputFocus;
+    next->length = 1;
+
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    assert(fcntl(fds[0], F_SETFL, O_NONBLOCK) == 0);
+    assert(fcntl(fds[1], F_SETFL, O_NONBLOCK) == 0);
+    ciptr = _XSERVTransReopenCOTSServer(5, fds[0], ":0");
+    assert(ciptr);
+
+    memset(&client, 0, sizeof(client));
+    memset(&oc, 0, sizeof(oc));
+    oc.fd = fds[0];
+    oc.trans_conn = ciptr;
+    client.osPrivate = &oc;
+    client.big_requests = TRUE;
+    maxBigRequestSize = limit;
+
+    /* The rest of the oversized request is skipped with the reads filling
+     * the buffer, the request after it must come out intact. */
+    for (;;) {
+        if (sent < len)
+            sent += write_some(fds[1], data + sent, len - sent);
+
+        result = ReadRequestFromClient(&client);
+        assert(result >= 0);
+        if (result == 0)
+            continue;
+
+        if (!oversized) {
+            assert(result == words * 4);
+            oversized = 1;
+            continue;
+        }
+
+        assert(result == sizeof(xReq));
+        assert(((xReq *) client.requestBuffer)->reqType == X_GetInputFocus);
+        break;
+    }
+    assert(sent == len);
+
+    maxBigRequestSize = oldMaxBigRequestSize;
+    FreeOsBuffers(&oc);
+    _XSERVTransClose(ciptr);
+    close(fds[1]);
+    free(data);
+}
+
 int
 main(int argc, char **argv)
 {
     block_sigio_test();
     block_sigio_test_nested();
+    read_request_oversized_test();
     return 0;
 }
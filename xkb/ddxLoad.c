@@ -32,6 +32,7 @@ THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #include <stdio.h>
 #include <ctype.h>
+#include <sys/stat.h>
 #include <X11/X.h>
 #include <X11/Xos.h>
 #include <X11/Xproto.h>
@@ -71,6 +72,10 @@ THE USE OR PERFORMANCE OF THIS SOFTWARE.
 static unsigned
 LoadXKM(unsigned want, unsigned need, const char *keymap, XkbDescPtr *xkbRtrn);
 
+/* Name of the compiled keymap file if not "server-<display>", for a DDX
+ * which has no display number of its own yet. */
+const char *XkbKeymapOutputName = NULL;
+
 static void
 OutputDirectory(char *outdir, size_t size)
 {
@@ -122,7 +127,10 @@ RunXkbComp(xkbcomp_buffer_callback callback, void *userdata)
     const char *xkmfile = "-";
 #endif
 
-    snprintf(keymap, sizeof(keymap), "server-%s", display);
+    if (XkbKeymapOutputName)
+        snprintf(keymap, sizeof(keymap), "%s", XkbKeymapOutputName);
+    else
+        snprintf(keymap, sizeof(keymap), "server-%s", display);
 
     OutputDirectory(xkm_output_dir, sizeof(xkm_output_dir));
 
@@ -558,3 +566,125 @@ XkbCompileKeymapFromString(DeviceIntPtr dev,
 
     return KeymapOrDefaults(dev, xkb);
 }
+
+/**
+ * A cached keymap is only used if it belongs to us, nobody else can modify
+ * it and it is newer than the rules file it was generated from and the
+ * component directories.  Package upgrades replace files by renaming, which
+ * updates the directory; files edited in place are not noticed, the cache
+ * has to be removed from the keymap output directory after such edits.
+ */
+static Bool
+XkbCachedKeymapIsValid(FILE *file, const char *rules_name)
+{
+    static const char *components[] = {
+        "keycodes", "types", "compat", "symbols"
+    };
+    struct stat cached, source;
+    char buf[PATH_MAX];
+    int i;
+
+    if (fstat(fileno(file), &cached) != 0)
+        return FALSE;
+
+    if (cached.st_uid != geteuid() || (cached.st_mode & (S_IWGRP | S_IWOTH)))
+        return FALSE;
+
+    if (snprintf(buf, PATH_MAX, "%s/rules/%s", XkbBaseDirectory, rules_name)
+        >= PATH_MAX || stat(buf, &source) != 0 ||
+        cached.st_mtime < source.st_mtime)
+        return FALSE;
+
+    for (i = 0; i < ARRAY_SIZE(components); i++) {
+        if (snprintf(buf, PATH_MAX, "%s/%s", XkbBaseDirectory, components[i])
+            >= PATH_MAX || stat(buf, &source) != 0 ||
+            cached.st_mtime < source.st_mtime)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Compile the given RMLVO keymap like XkbCompileKeymap, but keep the
+ * compiled keymap as cacheName.xkm in the keymap output directory and load
+ * it from there as long as it is valid, skipping xkbcomp. Returns NULL on
+ * failure, there is no fallback to the default keymap.
+ */
+XkbDescPtr
+XkbCompileKeymapCached(DeviceIntPtr dev, XkbRMLVOSet * rmlvo,
+                       const char *cacheName)
+{
+    XkbDescPtr xkb = NULL;
+    XkbComponentNamesRec kccgst = { 0 };
+    char name[PATH_MAX], fileName[PATH_MAX], cacheFileName[PATH_MAX];
+    unsigned int need, missing;
+    FILE *file;
+    Bool compiled;
+
+    if (!dev || !dev->key || !rmlvo || !rmlvo->rules || !cacheName) {
+        LogMessage(X_ERROR, "XKB: No device, RMLVO or cache name specified\n");
+        return NULL;
+    }
+
+    need = XkmSymbolsMask | XkmCompatMapMask | XkmTypesMask |
+        XkmKeyNamesMask | XkmVirtualModsMask;
+
+    file = XkbDDXOpenConfigFile(cacheName, cacheFileName, PATH_MAX);
+    if (file != NULL) {
+        if (XkbCachedKeymapIsValid(file, rmlvo->rules)) {
+            missing = XkmReadFile(file, need, XkmAllIndicesMask, &xkb);
+            if (xkb && (need & missing)) {
+                XkbFreeKeyboard(xkb, 0, TRUE);
+                xkb = NULL;
+            }
+        }
+        fclose(file);
+
+        if (xkb) {
+            DebugF("Loaded cached XKB keymap %s\n", cacheFileName);
+            return xkb;
+        }
+    }
+
+    if (!XkbRMLVOtoKcCGST(dev, rmlvo, &kccgst)) {
+        XkbFreeComponentNames(&kccgst, FALSE);
+        return NULL;
+    }
+
+    compiled = XkbDDXCompileKeymapByNames(dev->key->xkbInfo->desc, &kccgst,
+                                          XkmAllIndicesMask, need,
+                                          name, PATH_MAX);
+    XkbFreeComponentNames(&kccgst, FALSE);
+
+    if (!compiled) {
+        LogMessage(X_ERROR, "XKB: Couldn't compile keymap\n");
+        return NULL;
+    }
+
+    file = XkbDDXOpenConfigFile(name, fileName, PATH_MAX);
+    if (file == NULL) {
+        LogMessage(X_ERROR, "Couldn't open compiled keymap file %s\n",
+                   fileName);
+        return NULL;
+    }
+
+    missing = XkmReadFile(file, need, XkmAllIndicesMask, &xkb);
+    fclose(file);
+
+    if (xkb && (need & missing)) {
+        XkbFreeKeyboard(xkb, 0, TRUE);
+        xkb = NULL;
+    }
+
+    /* keep a complete keymap for the next time, drop anything else */
+    if (!xkb || cacheFileName[0] == '\0' ||
+        chmod(fileName, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) != 0 ||
+        rename(fileName, cacheFileName) != 0)
+        (void) unlink(fileName);
+
+    if (!xkb)
+        LogMessage(X_ERROR, "Error loading keymap %s\n", fileName);
+
+    return xkb;
+}
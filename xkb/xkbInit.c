@@ -221,7 +221,7 @@ XkbInitRules(XkbRMLVOSet *rmlvo,
     rmlvo->options = options ? xnfstrdup(options) : NULL;
 }
 
-static void
+void
 XkbSetRulesUsed(XkbRMLVOSet * rmlvo)
 {
     free(XkbRulesUsed);